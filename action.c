@@ -0,0 +1,118 @@
+/*
+   xvisbell: visual bell for X11
+
+   Action pipeline: commands run whenever the bell rings
+
+   Commands are started with posix_spawn (vfork+exec in glibc) so starting one
+   never copies the address space. At most max_running commands run at a time
+   and at most max_queued more wait for a slot; anything beyond that is dropped,
+   so a bell storm can't turn into a fork bomb.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "action.h"
+#include "xvisbell.h"
+
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+bool action_add_command(struct action_pipeline *p, char *command) {
+    if (p->n_commands == ACTION_MAX_COMMANDS) return true;
+    p->commands[p->n_commands++] = command;
+    return false;
+}
+
+// Start command i. The caller must make sure there is a free slot.
+static void spawn(struct action_pipeline *p, int i) {
+    char *argv[] = {"sh", "-c", p->commands[i], NULL};
+    posix_spawnattr_t attr;
+    sigset_t none, defaults;
+    pid_t pid;
+
+    // The daemon blocks the signals it handles and ignores SIGPIPE, don't pass that on to the command
+    sigemptyset(&none);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+#ifdef POSIX_SPAWN_USEVFORK
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_USEVFORK);
+#else
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+#endif
+
+    uint64_t start = monotonic_ns();
+    int err = posix_spawn(&pid, "/bin/sh", NULL, &attr, argv, environ);
+    uint64_t elapsed = monotonic_ns() - start;
+    posix_spawnattr_destroy(&attr);
+
+    if (err) {
+        STAT_ADD(&stats, actions_failed, 1);
+        return;
+    }
+
+    STAT_ADD(&stats, actions_spawned, 1);
+    histogram_observe(&stats.spawn, elapsed);
+
+    for (unsigned int slot = 0; slot < p->max_running; slot++) {
+        if (p->running[slot] == 0) {
+            p->running[slot] = pid;
+            break;
+        }
+    }
+    p->n_running++;
+}
+
+static void enqueue(struct action_pipeline *p, int i) {
+    if (p->policy == ACTION_COALESCE && p->pending[i]) {
+        STAT_ADD(&stats, actions_coalesced, 1);
+        return;
+    }
+    if (p->queue_len == p->max_queued) {
+        STAT_ADD(&stats, actions_dropped, 1);
+        return;
+    }
+
+    p->queue[(p->queue_head + p->queue_len) % ACTION_MAX_QUEUE] = i;
+    p->queue_len++;
+    p->pending[i]++;
+    STAT_ADD(&stats, actions_queued, 1);
+}
+
+void action_bell(struct action_pipeline *p) {
+    for (int i = 0; i < p->n_commands; i++) {
+        if (p->n_running < p->max_running) spawn(p, i);
+        else enqueue(p, i);
+    }
+}
+
+void action_reap(struct action_pipeline *p) {
+    pid_t pid;
+    int status;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (unsigned int slot = 0; slot < p->max_running; slot++) {
+            if (p->running[slot] == pid) {
+                p->running[slot] = 0;
+                p->n_running--;
+                break;
+            }
+        }
+    }
+
+    while (p->queue_len && p->n_running < p->max_running) {
+        int i = p->queue[p->queue_head];
+        p->queue_head = (p->queue_head + 1) % ACTION_MAX_QUEUE;
+        p->queue_len--;
+        p->pending[i]--;
+        spawn(p, i);
+    }
+}
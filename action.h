@@ -0,0 +1,58 @@
+/*
+   xvisbell: visual bell for X11
+
+   Action pipeline: commands run whenever the bell rings
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_ACTION_H
+#define XVISBELL_ACTION_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define ACTION_MAX_COMMANDS 16 // Maximum number of -e options
+#define ACTION_MAX_RUNNING 64 // Upper bound for --exec-max
+#define ACTION_MAX_QUEUE 256 // Upper bound for --exec-queue
+
+// What to do with a bell when every slot in the pool is busy
+enum action_policy {
+    ACTION_COALESCE, // Keep at most one queued run per command
+    ACTION_DROP, // Queue every run until the queue is full
+};
+
+struct action_pipeline {
+    char *commands[ACTION_MAX_COMMANDS]; // Passed to /bin/sh -c
+    int n_commands;
+
+    unsigned int max_running; // Size of the concurrency pool
+    unsigned int max_queued; // Length of the queue
+    enum action_policy policy;
+
+    pid_t running[ACTION_MAX_RUNNING]; // 0 for a free slot
+    unsigned int n_running;
+
+    int queue[ACTION_MAX_QUEUE]; // Ring buffer of command indices
+    unsigned int queue_head, queue_len;
+    unsigned int pending[ACTION_MAX_COMMANDS]; // Queued runs per command
+};
+
+#define ACTION_PIPELINE_DEFAULT {.max_running = 4, .max_queued = 16, .policy = ACTION_COALESCE}
+
+/*
+ * Add a command to run on every bell
+ * Returns true if there are already ACTION_MAX_COMMANDS commands
+ */
+bool action_add_command(struct action_pipeline *p, char *command);
+
+// Run (or queue) every configured command for one bell
+void action_bell(struct action_pipeline *p);
+
+// Reap finished commands and start queued ones. Call after SIGCHLD.
+void action_reap(struct action_pipeline *p);
+
+#endif
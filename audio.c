@@ -0,0 +1,177 @@
+/*
+   xvisbell: visual bell for X11
+
+   Sound action: a preloaded PCM sample played through ALSA for each bell
+
+   The sample is decoded once at startup and the device is opened and
+   prepared up front, so a bell costs one mix and one write of the device
+   buffer. Overlapping bells are mixed from a fixed set of voices into a
+   preallocated buffer. While anything is playing the buffer is topped up
+   once per period from the event loop's deadlines, and once it has played
+   out the device is prepared again, ready for the next bell.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "audio.h"
+#include "xvisbell.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static uint32_t le32(const unsigned char *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static uint16_t le16(const unsigned char *p) {
+    return p[0] | p[1] << 8;
+}
+
+bool audio_load_wav(struct audio *a, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return true;
+
+    unsigned char header[12], chunk[8], format[16];
+    bool have_format = false;
+    a->sample = NULL;
+
+    if (fread(header, 1, 12, f) != 12 || memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
+        fclose(f);
+        return true;
+    }
+
+    while (fread(chunk, 1, 8, f) == 8) {
+        uint32_t size = le32(chunk + 4);
+
+        if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+            if (fread(format, 1, 16, f) != 16) break;
+            // Only uncompressed 16 bit samples, which need no decoding per bell
+            if (le16(format) != 1 || le16(format + 14) != 16) break;
+            a->channels = le16(format + 2);
+            a->rate = le32(format + 4);
+            have_format = a->channels > 0 && a->rate > 0;
+            if (fseek(f, size - 16 + (size & 1), SEEK_CUR) != 0) break;
+        } else if (memcmp(chunk, "data", 4) == 0 && have_format) {
+            a->frames = size / (2 * a->channels);
+            a->sample = malloc(a->frames * a->channels * sizeof(int16_t));
+            if (a->sample == NULL) break;
+
+            unsigned char *bytes = (unsigned char *) a->sample;
+            if (fread(bytes, 2 * a->channels, a->frames, f) != a->frames) {
+                free(a->sample);
+                a->sample = NULL;
+                break;
+            }
+            // Convert from little endian in place (a no-op copy on little endian machines)
+            for (snd_pcm_uframes_t i = 0; i < a->frames * a->channels; i++) {
+                a->sample[i] = (int16_t) le16(bytes + 2 * i);
+            }
+            break;
+        } else if (fseek(f, size + (size & 1), SEEK_CUR) != 0) {
+            break;
+        }
+    }
+    fclose(f);
+
+    if (a->sample == NULL || a->frames == 0) return true;
+    // Best effort: without CAP_IPC_LOCK a large sample may exceed RLIMIT_MEMLOCK
+    mlock(a->sample, a->frames * a->channels * sizeof(int16_t));
+    return false;
+}
+
+int audio_open(struct audio *a, const char *device) {
+    int error = snd_pcm_open(&a->pcm, device, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
+    if (error < 0) return error;
+
+    // Also prepares the device
+    error = snd_pcm_set_params(a->pcm, SND_PCM_FORMAT_S16, SND_PCM_ACCESS_RW_INTERLEAVED, a->channels, a->rate,
+                               1, AUDIO_LATENCY_US);
+    if (error < 0) return error;
+    error = snd_pcm_get_params(a->pcm, &a->buffer_size, &a->period_size);
+    if (error < 0) return error;
+
+    size_t mix_bytes = a->buffer_size * a->channels * sizeof(int16_t);
+    a->mix = malloc(mix_bytes);
+    if (a->mix == NULL) return -ENOMEM;
+    mlock(a->mix, mix_bytes);
+
+    a->n_voices = 0;
+    a->idle_at = 0;
+    return 0;
+}
+
+// Mix the playing voices into as much of the device buffer as is free and write it
+static void fill(struct audio *a, uint64_t now) {
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(a->pcm);
+    if (avail < 0) {
+        // Underrun, e.g. the event loop was held up for longer than the buffer
+        STAT_ADD(&stats, sound_xruns, 1);
+        snd_pcm_prepare(a->pcm);
+        avail = a->buffer_size;
+    }
+    if ((snd_pcm_uframes_t) avail > a->buffer_size) avail = a->buffer_size;
+
+    // Whole buffers are written, padded with silence, so playback starts as soon as a bell arrives
+    unsigned int channels = a->channels;
+    for (snd_pcm_sframes_t frame = 0; frame < avail; frame++) {
+        for (unsigned int c = 0; c < channels; c++) {
+            int32_t sum = 0;
+            for (int v = 0; v < a->n_voices; v++) {
+                snd_pcm_uframes_t position = a->voices[v] + frame;
+                if (position < a->frames) sum += a->sample[position * channels + c];
+            }
+            a->mix[frame * channels + c] = sum > INT16_MAX ? INT16_MAX : sum < INT16_MIN ? INT16_MIN : sum;
+        }
+    }
+
+    // Advance the voices and drop the ones that have finished, keeping the oldest first
+    int kept = 0;
+    for (int v = 0; v < a->n_voices; v++) {
+        a->voices[v] += avail;
+        if (a->voices[v] < a->frames) a->voices[kept++] = a->voices[v];
+    }
+    a->n_voices = kept;
+
+    snd_pcm_writei(a->pcm, a->mix, avail);
+
+    uint64_t period_ns = (uint64_t) a->period_size * 1000000000 / a->rate;
+    snd_pcm_sframes_t delay;
+    if (snd_pcm_delay(a->pcm, &delay) < 0) delay = a->buffer_size;
+    a->next_fill = now + period_ns;
+    a->idle_at = now + (uint64_t) delay * 1000000000 / a->rate;
+}
+
+void audio_bell(struct audio *a) {
+    if (a->n_voices == AUDIO_VOICES) {
+        // Restart the oldest rather than allocate another voice
+        memmove(a->voices, a->voices + 1, (AUDIO_VOICES - 1) * sizeof(a->voices[0]));
+        a->n_voices--;
+        STAT_ADD(&stats, sounds_stolen, 1);
+    }
+    a->voices[a->n_voices++] = 0;
+    STAT_ADD(&stats, sounds, 1);
+    fill(a, monotonic_ns());
+}
+
+bool audio_next_deadline(const struct audio *a, uint64_t *deadline) {
+    if (a->n_voices) *deadline = a->next_fill;
+    else if (a->idle_at) *deadline = a->idle_at;
+    else return false;
+    return true;
+}
+
+void audio_run(struct audio *a, uint64_t now) {
+    if (a->n_voices) {
+        if (now >= a->next_fill) fill(a, now);
+    } else if (a->idle_at && now >= a->idle_at) {
+        // Everything has played, so stop before the device underruns and prime it for the next bell
+        snd_pcm_drop(a->pcm);
+        snd_pcm_prepare(a->pcm);
+        a->idle_at = 0;
+    }
+}
@@ -0,0 +1,61 @@
+/*
+   xvisbell: visual bell for X11
+
+   Sound action: a preloaded PCM sample played through ALSA for each bell
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_AUDIO_H
+#define XVISBELL_AUDIO_H
+
+#include <alsa/asoundlib.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define AUDIO_VOICES 4 // Overlapping bells mixed at once. Another bell restarts the oldest.
+#define AUDIO_LATENCY_US 20000 // Requested device buffer length
+
+struct audio {
+    snd_pcm_t *pcm;
+    unsigned int channels, rate;
+    int16_t *sample; // Interleaved frames, locked in memory
+    snd_pcm_uframes_t frames; // Length of the sample
+    int16_t *mix; // Room for a whole device buffer of mixed frames, locked in memory
+    snd_pcm_uframes_t buffer_size, period_size;
+
+    snd_pcm_uframes_t voices[AUDIO_VOICES]; // Next frame of the sample for each playing bell, oldest first
+    int n_voices;
+    uint64_t next_fill; // When to top up the device buffer while voices are playing
+    uint64_t idle_at; // When everything written has been played, 0 if the device is primed and idle
+};
+
+/*
+ * Load a 16 bit PCM WAV file into locked memory
+ * Returns true on error
+ */
+bool audio_load_wav(struct audio *a, const char *path);
+
+/*
+ * Open and prepare the ALSA device for the loaded sample's format
+ * Returns 0 or a negative ALSA error code (see snd_strerror)
+ */
+int audio_open(struct audio *a, const char *device);
+
+// Start playing the sample for a bell, mixed with any bells still sounding. Doesn't allocate.
+void audio_bell(struct audio *a);
+
+/*
+ * Get when audio_run has to be called next
+ * Returns false if nothing is playing
+ */
+bool audio_next_deadline(const struct audio *a, uint64_t *deadline);
+
+// Top up the device buffer, or re-prime the device once the last bell has played out
+void audio_run(struct audio *a, uint64_t now);
+
+#endif
@@ -0,0 +1,65 @@
+#!/bin/sh
+# Measure the time from exec to the first flash for resident (eager) and
+# on-demand (--lazy, socket activated when systemd-socket-activate is
+# available) startup against Xvfb. Requires socat.
+#
+# Usage: bench/coldstart.sh <xvisbell binary> [runs]
+
+set -e
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <xvisbell binary> [runs]"
+    exit 1
+fi
+
+binary=$1
+runs=${2:-20}
+sock=${TMPDIR:-/tmp}/xvisbell-coldstart.$$.sock
+
+display=:${XVFB_DISPLAY:-99}
+Xvfb "$display" -screen 0 1920x1080x24 -nolisten tcp >/dev/null 2>&1 &
+xvfb=$!
+trap 'kill $xvfb; rm -f "$sock"' EXIT
+sleep 1
+export DISPLAY=$display
+
+now_us() {
+    echo $(($(date +%s%N) / 1000))
+}
+
+# Print the exec to first flash time (us) as seen from outside and as reported by xvisbell
+run() {
+    mode=$1
+    rm -f "$sock"
+    start=$(now_us)
+    if [ "$mode" = activated ]; then
+        systemd-socket-activate -l "$sock" "$binary" --lazy >/dev/null 2>&1 &
+        # systemd-socket-activate creates the socket before exec'ing xvisbell
+        while [ ! -S "$sock" ]; do :; done
+    elif [ "$mode" = lazy ]; then
+        "$binary" --lazy --control "$sock" >/dev/null &
+    else
+        "$binary" --control "$sock" >/dev/null &
+    fi
+    pid=$!
+    until echo flash | socat - "UNIX-CONNECT:$sock" >/dev/null 2>&1; do :; done
+    end=$(now_us)
+    internal=$(echo stats | socat - "UNIX-CONNECT:$sock" | sed -n 's/^first flash after: \([0-9]*\) us/\1/p')
+    kill "$pid"
+    wait "$pid" 2>/dev/null || true
+    echo "$((end - start)) $internal"
+}
+
+modes="eager lazy"
+command -v systemd-socket-activate >/dev/null && modes="$modes activated"
+
+for mode in $modes; do
+    for i in $(seq "$runs"); do
+        run "$mode"
+    done | sort -n | awk -v mode="$mode" '
+        { external[NR] = $1; internal[NR] = $2 }
+        END {
+            printf "%-10s exec to first flash: median %d us (xvisbell reports %d us from main)\n",
+                   mode, external[int((NR + 1) / 2)], internal[int((NR + 1) / 2)]
+        }'
+done
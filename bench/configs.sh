@@ -0,0 +1,40 @@
+#!/bin/sh
+# Build xvisbell in each configuration of the optional parts (see the
+# Makefile) and compare them: binary size, shared libraries linked, startup
+# (xvisbell --startup-trace) and flash timing (xvisbell --selfcheck) on a
+# local Xvfb display. Each configuration is built in a copy of the sources,
+# so the tree's own build is left alone.
+#
+# Usage: bench/configs.sh [make flags]...
+# e.g. bench/configs.sh "MINIMAL=1" "" "FULL=1"
+# Defaults to MINIMAL=1 and the default build.
+
+set -e
+
+if [ $# -eq 0 ]; then
+    set -- "MINIMAL=1" ""
+fi
+
+source=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+
+display=:${XVFB_DISPLAY:-99}
+Xvfb "$display" -screen 0 1920x1080x24 -nolisten tcp >/dev/null 2>&1 &
+xvfb=$!
+trap 'kill $xvfb; rm -rf "$work"' EXIT
+sleep 1
+
+for flags in "$@"; do
+    echo "== make ${flags:-(defaults)}"
+    build=$work/build
+    rm -rf "$build"
+    mkdir "$build"
+    cp "$source"/*.c "$source"/*.h "$source"/Makefile "$build"
+    # Unquoted so there can be several flags
+    make -s -C "$build" $flags xvisbell >/dev/null
+    binary=$build/xvisbell
+    echo "size:      $(stat -c %s "$binary") bytes ($(size "$binary" | awk 'NR == 2 { print $1 }') bytes of text)"
+    echo "libraries: $(ldd "$binary" | wc -l) ($(ldd "$binary" | awk '/lib(X|asound)/ { sub(/\.so.*/, "", $1); printf "%s ", $1 }'))"
+    DISPLAY=$display "$binary" --startup-trace | sed 's/^/startup:   /'
+    DISPLAY=$display "$binary" -d 2 --selfcheck 1000 | sed 's/^/selfcheck: /'
+done
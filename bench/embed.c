@@ -0,0 +1,182 @@
+/*
+   xvisbell: visual bell for X11
+
+   Overhead of embedding: rings the bell the same way for the standalone
+   daemon and for libxvisbell hosted in a poll() loop the way another
+   program would, and prints the CPU time and peak RSS of each. The host
+   also prints the time spent in xvisbell_dispatch.
+
+   The bells come from a child process in both cases, so the ringing isn't
+   counted against either, and CPU time is counted from connecting to the
+   display. The daemon runs first, by itself, and is sent SIGTERM once its
+   last flash is over.
+
+   Usage: bench/embed [<bells> [<interval in ms> [<xvisbell binary>]]]
+   Needs a display, e.g. Xvfb. The binary defaults to ./xvisbell.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "../libxvisbell.h"
+#include "../xvisbell.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define DURATION_MS 2 // Of each flash, short so the flashes don't merge
+
+static int compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static double cpu_ms(const struct rusage *usage) {
+    return (usage->ru_utime.tv_sec + usage->ru_stime.tv_sec) * 1e3
+           + (usage->ru_utime.tv_usec + usage->ru_stime.tv_usec) / 1e3;
+}
+
+// Ring the bell from a child process with its own connection. Returns its PID.
+static pid_t ring(int bells, int interval) {
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+
+    Display *ringer = XOpenDisplay(NULL);
+    if (ringer == NULL) _exit(1);
+    for (int i = 0; i < bells; i++) {
+        XBell(ringer, 100);
+        XFlush(ringer);
+        usleep(interval * 1000);
+    }
+    XCloseDisplay(ringer);
+    _exit(0);
+}
+
+// Run the daemon for the bells and print what it used. Returns true on error.
+static bool standalone(const char *binary, int bells, int interval) {
+    pid_t daemon = fork();
+    if (daemon < 0) return true;
+    if (daemon == 0) {
+        execl(binary, binary, "-d", "2", (char *) NULL);
+        _exit(127);
+    }
+    // Long enough for it to be listening
+    usleep(500000);
+
+    int status;
+    waitpid(ring(bells, interval), &status, 0);
+    usleep((DURATION_MS + 100) * 1000);
+    kill(daemon, SIGTERM);
+    struct rusage usage;
+    if (wait4(daemon, &status, 0, &usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("Error running %s\n", binary);
+        return true;
+    }
+    printf("standalone: %.1f ms CPU, %.1f us per bell, peak RSS %ld KiB\n",
+           cpu_ms(&usage), cpu_ms(&usage) * 1e3 / bells, usage.ru_maxrss);
+    return false;
+}
+
+static void count_bell(XkbBellNotifyEvent *ev, uint64_t recv_ns, bool limited, void *data) {
+    (void) ev;
+    (void) recv_ns;
+    (void) limited;
+    (*(int *) data)++;
+}
+
+static struct xvisbell v;
+
+static int handle_x_error(Display *display, XErrorEvent *error) {
+    if (!xvisbell_x_error(&v, display, error)) xerror_count(v.stats, NULL, error);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int bells = argc > 1 ? atoi(argv[1]) : 1000;
+    int interval = argc > 2 ? atoi(argv[2]) : 5;
+    const char *binary = argc > 3 ? argv[3] : "./xvisbell";
+    if (bells <= 0 || interval < 0) {
+        printf("Usage: %s [<bells> [<interval in ms> [<xvisbell binary>]]]\n", argv[0]);
+        return 1;
+    }
+
+    if (standalone(binary, bells, interval)) return 1;
+
+    // From connecting on, like the daemon's CPU time
+    struct rusage before;
+    getrusage(RUSAGE_SELF, &before);
+    Display *display = XOpenDisplay(NULL);
+    if (display == NULL) {
+        printf("Error opening display\n");
+        return 1;
+    }
+
+    int rung = 0;
+    struct xvisbell_config config = XVISBELL_CONFIG_DEFAULT;
+    config.duration_ns = DURATION_MS * 1000000ULL;
+    config.on_bell = count_bell;
+    config.on_bell_data = &rung;
+    xvisbell_init(&v, display, &config);
+    XSetErrorHandler(handle_x_error);
+    if (xvisbell_listen(&v) || xvisbell_setup(&v)) {
+        printf("%s\n", xvisbell_error(&v));
+        return 1;
+    }
+    XSync(display, False);
+
+    // Time of each dispatch that handled a bell, which may have read several
+    uint64_t *times = malloc(bells * sizeof(uint64_t));
+    if (times == NULL) {
+        printf("Error allocating %d samples\n", bells);
+        return 1;
+    }
+    int n = 0, dispatches = 0;
+    uint64_t total = 0;
+
+    pid_t ringer = ring(bells, interval);
+    while (rung < bells || xvisbell_visible(&v)) {
+        uint64_t deadline = xvisbell_next_deadline(&v);
+        int timeout = -1;
+        if (deadline != UINT64_MAX) {
+            uint64_t now = monotonic_ns();
+            timeout = deadline > now ? (deadline - now + 999999) / 1000000 : 0;
+        }
+        struct pollfd fd = {.fd = xvisbell_fd(&v), .events = POLLIN};
+        poll(&fd, 1, timeout);
+
+        int before_rung = rung;
+        uint64_t start = monotonic_ns();
+        if (xvisbell_dispatch(&v)) {
+            printf("%s\n", xvisbell_error(&v));
+            return 1;
+        }
+        uint64_t elapsed = monotonic_ns() - start;
+        dispatches++;
+        total += elapsed;
+        if (rung > before_rung && n < bells) times[n++] = elapsed;
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    int status;
+    waitpid(ringer, &status, 0);
+
+    double cpu = cpu_ms(&usage) - cpu_ms(&before);
+    qsort(times, n, sizeof(uint64_t), compare);
+    printf("embedded: %.1f ms CPU, %.1f us per bell, peak RSS %ld KiB\n", cpu, cpu * 1e3 / bells, usage.ru_maxrss);
+    printf("embedded: %d dispatches, %.1f us per dispatch\n", dispatches, total / 1e3 / dispatches);
+    printf("%d dispatches with a bell: p50 %.1f us, p99 %.1f us, max %.1f us\n", n,
+           times[n / 2] / 1e3, times[n * 99 / 100] / 1e3, times[n - 1] / 1e3);
+
+    xvisbell_free(&v);
+    XCloseDisplay(display);
+    free(times);
+    return 0;
+}
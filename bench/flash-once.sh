@@ -0,0 +1,39 @@
+#!/bin/sh
+# Compare xvisbell -f between builds against Xvfb: with -d 0 the runtime is
+# (almost entirely) the time from exec to the flash, with -d 100 it is the total
+# runtime of a typical flash.
+#
+# Usage: bench/flash-once.sh <runs> <xvisbell binary>...
+
+set -e
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 <runs> <xvisbell binary>..."
+    exit 1
+fi
+
+runs=$1
+shift
+
+display=:${XVFB_DISPLAY:-99}
+Xvfb "$display" -screen 0 1920x1080x24 -nolisten tcp >/dev/null 2>&1 &
+xvfb=$!
+trap 'kill $xvfb' EXIT
+sleep 1
+export DISPLAY=$display
+
+# Median wall clock time in us of running the arguments
+median_us() {
+    for i in $(seq "$runs"); do
+        start=$(date +%s%N)
+        "$@"
+        end=$(date +%s%N)
+        echo $(((end - start) / 1000))
+    done | sort -n | awk '{ t[NR] = $1 } END { print t[int((NR + 1) / 2)] }'
+}
+
+for binary in "$@"; do
+    echo "== $binary"
+    echo "startup to flash (-d 0): $(median_us "$binary" -f -d 0) us"
+    echo "total runtime (-d 100): $(median_us "$binary" -f -d 100) us"
+done
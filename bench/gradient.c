@@ -0,0 +1,73 @@
+/*
+   xvisbell: visual bell for X11
+
+   Micro-benchmark of the gradient kernels: generates 8K gradients with each
+   kernel the CPU supports, checks they match the scalar kernel and prints
+   the time per buffer.
+
+   Usage: bench/gradient [<width> <height> [<runs>]]
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "../gradient.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t now_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned int width = argc > 2 ? atoi(argv[1]) : 7680;
+    unsigned int height = argc > 2 ? atoi(argv[2]) : 4320;
+    int runs = argc > 3 ? atoi(argv[3]) : 10;
+    if (width == 0 || height == 0 || runs <= 0) {
+        printf("Usage: %s [<width> <height> [<runs>]]\n", argv[0]);
+        return 1;
+    }
+
+    size_t n = (size_t) width * height;
+    uint32_t *reference = malloc(n * sizeof(uint32_t));
+    uint32_t *pixels = malloc(n * sizeof(uint32_t));
+    if (reference == NULL || pixels == NULL) {
+        printf("Error allocating %ux%u buffers\n", width, height);
+        return 1;
+    }
+
+    const char *kind_names[] = {"horizontal", "vertical", "vignette"};
+    int failed = 0;
+    printf("%ux%u, best of %d runs\n", width, height, runs);
+    for (int kind = GRADIENT_HORIZONTAL; kind <= GRADIENT_VIGNETTE; kind++) {
+        gradient_fill(reference, width, width, height, kind, 0xff102030, 0xffe0c0a0, GRADIENT_SCALAR);
+
+        for (int kernel = 0; kernel < GRADIENT_KERNELS; kernel++) {
+            if (!gradient_kernel_supported(kernel)) continue;
+
+            uint64_t best = UINT64_MAX;
+            for (int run = 0; run < runs; run++) {
+                uint64_t start = now_ns();
+                gradient_fill(pixels, width, width, height, kind, 0xff102030, 0xffe0c0a0, kernel);
+                uint64_t elapsed = now_ns() - start;
+                if (elapsed < best) best = elapsed;
+            }
+
+            bool same = memcmp(pixels, reference, n * sizeof(uint32_t)) == 0;
+            if (!same) failed = 1;
+            printf("%-10s %-6s %8.2f ms %8.1f Mpixel/s%s\n", kind_names[kind], gradient_kernel_names[kernel],
+                   best / 1e6, n * 1e3 / best, same ? "" : "  MISMATCH");
+        }
+    }
+
+    free(reference);
+    free(pixels);
+    return failed;
+}
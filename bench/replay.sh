@@ -0,0 +1,31 @@
+#!/bin/sh
+# Replay a bell trace (recorded with xvisbell --record) against Xvfb with one
+# or more builds of xvisbell and print each build's stats for comparison.
+#
+# Usage: bench/replay.sh <trace> <speed> <xvisbell binary [options]>...
+# e.g. bench/replay.sh bells.trace 0 "./xvisbell" "./xvisbell --renderer overlay"
+# compares request counts and latency of the two renderers.
+# A speed of 0 replays the trace as fast as possible.
+
+set -e
+
+if [ $# -lt 3 ]; then
+    echo "Usage: $0 <trace> <speed> <xvisbell binary>..."
+    exit 1
+fi
+
+trace=$1
+speed=$2
+shift 2
+
+display=:${XVFB_DISPLAY:-99}
+Xvfb "$display" -screen 0 1920x1080x24 -nolisten tcp >/dev/null 2>&1 &
+xvfb=$!
+trap 'kill $xvfb' EXIT
+sleep 1
+
+for binary in "$@"; do
+    echo "== $binary"
+    # Unquoted so a binary can carry options, e.g. "./xvisbell --renderer overlay"
+    DISPLAY=$display $binary --replay "$trace" --replay-speed "$speed"
+done
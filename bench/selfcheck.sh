@@ -0,0 +1,30 @@
+#!/bin/sh
+# Time flashes against Xvfb with one or more builds of xvisbell (xvisbell
+# --selfcheck) and print how far each build's visible durations stray from
+# the requested one, e.g. to compare scheduler or timer changes.
+#
+# Usage: bench/selfcheck.sh <flashes> <duration in ms> <xvisbell binary [options]>...
+# e.g. bench/selfcheck.sh 5000 2.5 ./xvisbell.old ./xvisbell "./xvisbell --rt-priority 10"
+
+set -e
+
+if [ $# -lt 3 ]; then
+    echo "Usage: $0 <flashes> <duration in ms> <xvisbell binary>..."
+    exit 1
+fi
+
+flashes=$1
+duration=$2
+shift 2
+
+display=:${XVFB_DISPLAY:-99}
+Xvfb "$display" -screen 0 1920x1080x24 -nolisten tcp >/dev/null 2>&1 &
+xvfb=$!
+trap 'kill $xvfb' EXIT
+sleep 1
+
+for binary in "$@"; do
+    echo "== $binary"
+    # Unquoted so a binary can carry options
+    DISPLAY=$display $binary -d "$duration" --selfcheck "$flashes"
+done
@@ -0,0 +1,52 @@
+#!/bin/sh
+# Check that xvisbell is ready (Xkb set up, window created, everything synced)
+# within the startup budget on a local Xvfb display. Prints the median time of
+# each startup phase and exits with 1 if the median ready time is over budget.
+#
+# Usage: bench/startup.sh <xvisbell binary> [runs] [budget in us]
+
+set -e
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <xvisbell binary> [runs] [budget in us]"
+    exit 1
+fi
+
+binary=$1
+runs=${2:-50}
+budget=${3:-5000}
+
+display=:${XVFB_DISPLAY:-99}
+Xvfb "$display" -screen 0 1920x1080x24 -nolisten tcp >/dev/null 2>&1 &
+xvfb=$!
+trap 'kill $xvfb' EXIT
+sleep 1
+
+for i in $(seq "$runs"); do
+    DISPLAY=$display "$binary" --startup-trace
+done | awk -v runs="$runs" -v budget="$budget" '
+    {
+        phase = $0
+        sub(/: [0-9]+ us$/, "", phase)
+        if (!(phase in count)) order[++n] = phase
+        times[phase, ++count[phase]] = $(NF - 1)
+    }
+    function median(phase,    i, j, t, m) {
+        m = count[phase]
+        for (i = 1; i <= m; i++) sorted[i] = times[phase, i]
+        for (i = 2; i <= m; i++) {
+            t = sorted[i]
+            for (j = i - 1; j >= 1 && sorted[j] > t; j--) sorted[j + 1] = sorted[j]
+            sorted[j + 1] = t
+        }
+        return sorted[int((m + 1) / 2)]
+    }
+    END {
+        for (i = 1; i <= n; i++) printf "%-16s %6d us\n", order[i], median(order[i])
+        ready = median("ready")
+        if (ready > budget) {
+            printf "FAIL: median ready time %d us is over the %d us budget\n", ready, budget
+            exit 1
+        }
+        printf "OK: median ready time %d us is within the %d us budget\n", ready, budget
+    }'
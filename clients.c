@@ -0,0 +1,247 @@
+/*
+   xvisbell: visual bell for X11
+
+   Bell attribution: which client rang each bell, per-client counts and rate limits
+
+   Every resource a client creates has an ID starting with the base the
+   server gave its connection, so the client behind a bell is known from
+   the event's window without asking the server anything. Its _NET_WM_PID
+   is only for the statistics, so it is looked up later, once per window,
+   after the flash has gone out.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "clients.h"
+#include "xerror.h"
+#include "xvisbell.h"
+
+#include <X11/Xatom.h>
+#include <X11/Xlibint.h>
+
+void clients_init(struct clients *c, Display *display, struct xerrors *errors, struct stats *stats,
+                  unsigned long rate) {
+    c->display = display;
+    c->errors = errors;
+    c->stats = stats;
+    // The server gives every connection the same mask, only the base differs. Xlib only keeps it in the Display.
+    c->id_mask = display->resource_mask;
+    c->pid_atom = None;
+    c->rate = rate;
+    c->locate = false;
+    c->n = 0;
+    c->n_windows = 0;
+    c->next_window = 0;
+    c->unresolved = 0;
+}
+
+// Show the client in the stats if it is one of the noisiest
+static void publish(struct clients *c, const struct client *client) {
+    struct stats *s = c->stats;
+    // Its slot if it is already listed, otherwise the last one if it has overtaken that
+    int i = 0;
+    while (i < STATS_TOP_CLIENTS && STAT_GET(s, top_clients[i].bells) && STAT_GET(s, top_clients[i].id) != client->id) {
+        i++;
+    }
+    if (i == STATS_TOP_CLIENTS) {
+        i = STATS_TOP_CLIENTS - 1;
+        if (STAT_GET(s, top_clients[i].bells) >= client->bells) return;
+    }
+
+    struct client_stats entry = {client->id, client->pid, client->bells, client->rate_limited};
+    // Move it up past the clients it now has more bells than
+    for (; i > 0 && STAT_GET(s, top_clients[i - 1].bells) < entry.bells; i--) {
+        STAT_SET(s, top_clients[i].id, STAT_GET(s, top_clients[i - 1].id));
+        STAT_SET(s, top_clients[i].pid, STAT_GET(s, top_clients[i - 1].pid));
+        STAT_SET(s, top_clients[i].bells, STAT_GET(s, top_clients[i - 1].bells));
+        STAT_SET(s, top_clients[i].rate_limited, STAT_GET(s, top_clients[i - 1].rate_limited));
+    }
+    STAT_SET(s, top_clients[i].id, entry.id);
+    STAT_SET(s, top_clients[i].pid, entry.pid);
+    STAT_SET(s, top_clients[i].bells, entry.bells);
+    STAT_SET(s, top_clients[i].rate_limited, entry.rate_limited);
+}
+
+// Find the client with the given ID, adding it (and forgetting the quietest for longest if need be) if it's new
+static struct client *find_client(struct clients *c, XID id, uint64_t now) {
+    struct client *oldest = NULL;
+    for (int i = 0; i < c->n; i++) {
+        if (c->clients[i].id == id) return &c->clients[i];
+        if (oldest == NULL || c->clients[i].last_ns < oldest->last_ns) oldest = &c->clients[i];
+    }
+
+    struct client *client = c->n < CLIENTS_MAX ? &c->clients[c->n++] : oldest;
+    *client = (struct client){.id = id, .tokens = c->rate, .last_ns = now};
+    // A forgotten client that is still among the noisiest carries on from its old counts
+    for (int i = 0; i < STATS_TOP_CLIENTS && STAT_GET(c->stats, top_clients[i].bells); i++) {
+        if (STAT_GET(c->stats, top_clients[i].id) == id) {
+            client->pid = STAT_GET(c->stats, top_clients[i].pid);
+            client->bells = STAT_GET(c->stats, top_clients[i].bells);
+            client->rate_limited = STAT_GET(c->stats, top_clients[i].rate_limited);
+        }
+    }
+    return client;
+}
+
+// Remember that window rang the bell so its PID gets looked up
+static void add_window(struct clients *c, Window window, XID id) {
+    for (int i = 0; i < c->n_windows; i++) {
+        if (c->windows[i].window == window) return;
+    }
+
+    struct client_window *w;
+    if (c->n_windows < CLIENTS_WINDOWS) {
+        w = &c->windows[c->n_windows++];
+    } else {
+        w = &c->windows[c->next_window];
+        c->next_window = (c->next_window + 1) % CLIENTS_WINDOWS;
+    }
+    *w = (struct client_window){.window = window, .id = id, .screen = -1};
+    c->unresolved++;
+}
+
+bool clients_bell(struct clients *c, Window window, uint64_t now) {
+    XID id = window == None ? 0 : window & ~c->id_mask;
+    struct client *client = find_client(c, id, now);
+    if (window != None) add_window(c, window, id);
+
+    bool allowed = true;
+    // Bells without a window would lump every XBell() caller together, so only attributed ones are limited
+    if (c->rate && id) {
+        client->tokens += (now - client->last_ns) * c->rate / 1e9;
+        if (client->tokens > c->rate) client->tokens = c->rate;
+        if (client->tokens >= 1) {
+            client->tokens--;
+        } else {
+            client->rate_limited++;
+            STAT_ADD(c->stats, rate_limited, 1);
+            allowed = false;
+        }
+    }
+    client->bells++;
+    client->last_ns = now;
+    publish(c, client);
+    return allowed;
+}
+
+static void forget_window(struct clients *c, int i) {
+    c->windows[i] = c->windows[--c->n_windows];
+    if (c->next_window >= c->n_windows) c->next_window = 0;
+}
+
+// Get the screen whose root window is window, -1 if it isn't a root window
+static int root_screen(Display *display, Window window) {
+    for (int i = 0; i < ScreenCount(display); i++) {
+        if (XRootWindow(display, i) == window) return i;
+    }
+    return -1;
+}
+
+// Find out which screen the window is on and where
+static void locate(struct clients *c, struct client_window *w) {
+    Window root, child;
+    int x, y;
+    unsigned int width, height, border, depth;
+    if (!XGetGeometry(c->display, w->window, &root, &x, &y, &width, &height, &border, &depth)) return;
+    // The position is relative to the parent, e.g. the window manager's frame
+    if (!XTranslateCoordinates(c->display, w->window, root, 0, 0, &x, &y, &child)) return;
+
+    w->screen = root_screen(c->display, root);
+    w->x = x;
+    w->y = y;
+    w->width = width;
+    w->height = height;
+}
+
+void clients_resolve(struct clients *c) {
+    if (c->unresolved == 0) return;
+    c->unresolved = 0;
+    if (c->pid_atom == None) c->pid_atom = XInternAtom(c->display, "_NET_WM_PID", False);
+
+    // The window may be gone by now. The error goes to the error handler, and is also queued for recovery.
+    for (int i = 0; i < c->n_windows; i++) {
+        struct client_window *w = &c->windows[i];
+        unsigned long first = NextRequest(c->display);
+        if (w->resolved) {
+            if (!w->moved) continue;
+            // Only where it went is new
+            w->moved = false;
+            locate(c, w);
+            if (xerror_since(c->errors, first)) forget_window(c, i--);
+            continue;
+        }
+        w->resolved = true;
+
+        // Selecting on the root window would replace the events we already get from it
+        if (root_screen(c->display, w->window) < 0) XSelectInput(c->display, w->window, StructureNotifyMask);
+        Atom type;
+        int format;
+        unsigned long n, after;
+        unsigned char *data = NULL;
+        int status = XGetWindowProperty(c->display, w->window, c->pid_atom, 0, 1, False, XA_CARDINAL,
+                                        &type, &format, &n, &after, &data);
+        bool gone = xerror_since(c->errors, first);
+        if (gone) {
+            forget_window(c, i--);
+        } else if (status == Success && type == XA_CARDINAL && format == 32 && n == 1) {
+            // Format 32 properties come back as longs
+            unsigned long pid = *(unsigned long *) data;
+            for (int j = 0; j < c->n; j++) {
+                if (c->clients[j].id == w->id) {
+                    c->clients[j].pid = pid;
+                    publish(c, &c->clients[j]);
+                }
+            }
+        }
+        if (data) XFree(data);
+
+        if (c->locate && !gone) {
+            locate(c, w);
+            if (xerror_since(c->errors, first)) forget_window(c, i--);
+        }
+    }
+}
+
+bool clients_event(struct clients *c, XEvent *ev) {
+    // Only windows that rang the bell have StructureNotify selected
+    switch (ev->type) {
+    case DestroyNotify:
+        clients_forget(c, ev->xdestroywindow.window);
+        return true;
+    case ConfigureNotify:
+    case ReparentNotify:
+        // Moving the window manager's frame sends the window a synthetic ConfigureNotify
+        for (int i = 0; i < c->n_windows; i++) {
+            struct client_window *w = &c->windows[i];
+            if (w->window != ev->xany.window) continue;
+            if (c->locate && w->resolved && !w->moved) {
+                w->moved = true;
+                c->unresolved++;
+            }
+            return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+void clients_forget(struct clients *c, Window window) {
+    for (int i = 0; i < c->n_windows; i++) {
+        if (c->windows[i].window == window) {
+            if (!c->windows[i].resolved || c->windows[i].moved) c->unresolved--;
+            forget_window(c, i);
+            return;
+        }
+    }
+}
+
+const struct client_window *clients_window(const struct clients *c, Window window) {
+    for (int i = 0; i < c->n_windows; i++) {
+        if (c->windows[i].window == window) return &c->windows[i];
+    }
+    return NULL;
+}
@@ -0,0 +1,106 @@
+/*
+   xvisbell: visual bell for X11
+
+   Bell attribution: which client rang each bell, per-client counts and rate limits
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_CLIENTS_H
+#define XVISBELL_CLIENTS_H
+
+#include "xerror.h"
+
+#include <X11/Xlib.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CLIENTS_MAX 64 // Clients counted at once, the one heard from least recently is forgotten to make room
+#define CLIENTS_WINDOWS 256 // Windows whose client and PID are cached
+
+/*
+ * A client that rang the bell, identified by the resource ID base the server
+ * gave its connection (the same ID the X-Resource extension reports)
+ */
+struct client {
+    XID id; // 0 for bells without a window, which can't be attributed
+    unsigned long pid; // From _NET_WM_PID, 0 if unknown
+    uint64_t bells;
+    uint64_t rate_limited; // Bells over the rate limit
+    double tokens; // Bells allowed right now
+    uint64_t last_ns; // When it last rang the bell, and when tokens was last topped up
+};
+
+// A window that rang the bell
+struct client_window {
+    Window window;
+    XID id; // Its client
+    bool resolved; // Whether _NET_WM_PID has been looked up and StructureNotify selected
+    bool moved; // Whether it has moved or been reparented since it was located, when locating
+    int screen; // Where the window was when it was last located, screen -1 if that isn't known
+    int x, y; // Relative to the screen's root window
+    unsigned int width, height;
+};
+
+struct clients {
+    Display *display;
+    struct xerrors *errors; // Where the errors of lookups turn up
+    struct stats *stats; // Where rate limiting and the noisiest clients are counted
+    XID id_mask; // Bits of a resource ID that pick out the client
+    Atom pid_atom; // _NET_WM_PID, None until the first lookup
+    unsigned long rate; // Bells per second each client may ring (in bursts of up to that many), 0 for no limit
+    bool locate; // Whether to find out where windows are, to route their bells to a screen or monitor
+
+    struct client clients[CLIENTS_MAX];
+    int n;
+    struct client_window windows[CLIENTS_WINDOWS];
+    int n_windows;
+    int next_window; // Cache slot to replace once every slot is taken
+    int unresolved; // Windows waiting for clients_resolve, new or moved
+};
+
+/*
+ * Start counting. Nothing is sent to the server until clients_resolve.
+ * Errors on the display must reach errors (see xerror_event) to tell when a window has gone.
+ * Rate limiting and the noisiest clients are counted in stats.
+ * Set locate afterwards to find out where windows are too.
+ */
+void clients_init(struct clients *c, Display *display, struct xerrors *errors, struct stats *stats,
+                  unsigned long rate);
+
+/*
+ * Count a bell rung on window (None if the bell didn't name one)
+ * Only the window's resource ID is used, so this never waits for the server.
+ * Returns false if the client is over the rate limit and the bell should be ignored.
+ */
+bool clients_bell(struct clients *c, Window window, uint64_t now);
+
+/*
+ * Look up _NET_WM_PID (and where they are, if locating) for windows that have rung the bell since the last call,
+ * and ask for their structure events. If locating, also find out where moved windows went.
+ * This takes round trips if there are any, so call it after flushing the flashes.
+ */
+void clients_resolve(struct clients *c);
+
+/*
+ * Forget a destroyed window, or note that a window moved
+ * Returns true if the event was about a window that rang the bell, the only ones with StructureNotify selected
+ */
+bool clients_event(struct clients *c, XEvent *ev);
+
+// Forget a window that no longer exists, e.g. after an X error about it
+void clients_forget(struct clients *c, Window window);
+
+// Get the cached window, NULL if it hasn't rung the bell or has been forgotten
+const struct client_window *clients_window(const struct clients *c, Window window);
+
+// Whether the cached location of a window can't be used until the next clients_resolve
+static inline bool clients_unlocated(const struct clients *c, const struct client_window *w) {
+    return c->locate && (!w->resolved || w->moved);
+}
+
+#endif
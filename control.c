@@ -0,0 +1,90 @@
+/*
+   xvisbell: visual bell for X11
+
+   Control socket: a UNIX stream socket taking one command per connection
+
+   The event loop serves clients itself, so both directions get a short
+   timeout to stop a stuck client from holding up flashes for long.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "control.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+int control_open(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    // Commands run by the action pipeline shouldn't inherit the socket
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// First descriptor passed by socket activation
+#define LISTEN_FDS_START 3
+
+int control_from_listen_fds(void) {
+    const char *pid = getenv("LISTEN_PID");
+    const char *fds = getenv("LISTEN_FDS");
+    if (pid == NULL || fds == NULL || atol(pid) != (long) getpid() || atoi(fds) < 1) return -1;
+
+    // Don't pass these on to commands run by the action pipeline
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+
+    fcntl(LISTEN_FDS_START, F_SETFD, FD_CLOEXEC);
+    fcntl(LISTEN_FDS_START, F_SETFL, fcntl(LISTEN_FDS_START, F_GETFL) | O_NONBLOCK);
+    return LISTEN_FDS_START;
+}
+
+int control_accept(int listen_fd, char *line, size_t len) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) return -1;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    // Accepted sockets inherit O_NONBLOCK on some systems, the timeouts below need blocking I/O
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+    struct timeval timeout = {0, 100000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    timeout = (struct timeval){1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // Commands are tiny so read until the first newline or until the client stops sending
+    size_t used = 0;
+    while (used < len - 1) {
+        ssize_t n = read(fd, line + used, len - 1 - used);
+        if (n <= 0) break;
+        used += n;
+        if (memchr(line, '\n', used)) break;
+    }
+    line[used] = '\0';
+    line[strcspn(line, "\r\n")] = '\0';
+
+    if (used == 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
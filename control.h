@@ -0,0 +1,37 @@
+/*
+   xvisbell: visual bell for X11
+
+   Control socket: a UNIX stream socket taking one command per connection
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_CONTROL_H
+#define XVISBELL_CONTROL_H
+
+#include <stddef.h>
+
+#define CONTROL_MAX_COMMAND 128 // Longest command line accepted
+
+/*
+ * Listen on a UNIX socket at path, replacing any stale socket there
+ * Returns the listening socket or -1 on error
+ */
+int control_open(const char *path);
+
+/*
+ * Get a listening socket passed by socket activation (LISTEN_PID and LISTEN_FDS, as set by systemd)
+ * Returns the first passed socket or -1 if none was passed to this process
+ */
+int control_from_listen_fds(void);
+
+/*
+ * Accept a pending connection on listen_fd and read its command line (without the newline) into line
+ * Returns the connected socket, which the caller must close, or -1 if there was no usable connection
+ */
+int control_accept(int listen_fd, char *line, size_t len);
+
+#endif
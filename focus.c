@@ -0,0 +1,137 @@
+/*
+   xvisbell: visual bell for X11
+
+   Focus tracking: the active window (_NET_ACTIVE_WINDOW) and where it is, kept up to date from events
+
+   The window manager sets _NET_ACTIVE_WINDOW on the root window, so a
+   PropertyNotify says when focus moves and a ConfigureNotify when the
+   active window does. Both only mark the cache as out of date; the round
+   trips to read the new values happen in focus_resolve, after the flashes
+   have gone out, so a bell is routed without waiting for the server.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "focus.h"
+#include "xerror.h"
+
+#include <X11/Xatom.h>
+
+// Get the screen whose root window is window, -1 if it isn't a root window
+static int root_screen(Display *display, Window window) {
+    for (int i = 0; i < ScreenCount(display); i++) {
+        if (XRootWindow(display, i) == window) return i;
+    }
+    return -1;
+}
+
+void focus_init(struct focus *f, Display *display, struct xerrors *errors) {
+    f->display = display;
+    f->errors = errors;
+    f->active_atom = XInternAtom(display, "_NET_ACTIVE_WINDOW", False);
+    f->changed_root = XDefaultRootWindow(display);
+    f->window = None;
+    f->moved = false;
+    f->screen = -1;
+
+    for (int i = 0; i < ScreenCount(display); i++) {
+        // Selecting replaces this connection's whole mask on the window, so add to what is already there
+        XWindowAttributes attrs;
+        XGetWindowAttributes(display, XRootWindow(display, i), &attrs);
+        XSelectInput(display, XRootWindow(display, i), attrs.your_event_mask | PropertyChangeMask);
+    }
+}
+
+bool focus_event(struct focus *f, XEvent *ev) {
+    switch (ev->type) {
+    case PropertyNotify:
+        if (root_screen(f->display, ev->xproperty.window) < 0) return false;
+        if (ev->xproperty.atom == f->active_atom) f->changed_root = ev->xproperty.window;
+        return true;
+    case ConfigureNotify:
+    case ReparentNotify:
+        // Moving the window manager's frame sends the window a synthetic ConfigureNotify
+        if (ev->xany.window != f->window) return false;
+        f->moved = true;
+        return true;
+    case DestroyNotify:
+        focus_forget(f, ev->xdestroywindow.window);
+        return false;
+    default:
+        return false;
+    }
+}
+
+void focus_forget(struct focus *f, Window window) {
+    if (window != f->window) return;
+    f->window = None;
+    f->moved = false;
+    f->screen = -1;
+}
+
+// Get the active window from a root window's _NET_ACTIVE_WINDOW, None if there isn't one
+static Window read_active(struct focus *f, Window root) {
+    Atom type;
+    int format;
+    unsigned long n, after;
+    unsigned char *data = NULL;
+    Window active = None;
+    if (XGetWindowProperty(f->display, root, f->active_atom, 0, 1, False, XA_WINDOW,
+                           &type, &format, &n, &after, &data) == Success
+        && type == XA_WINDOW && format == 32 && n == 1) {
+        // Format 32 properties come back as longs
+        active = *(unsigned long *) data;
+    }
+    if (data) XFree(data);
+    return active;
+}
+
+// Find out which screen the active window is on and where
+static void locate(struct focus *f) {
+    Window root, child;
+    int x, y;
+    unsigned int width, height, border, depth;
+    f->screen = -1;
+    if (!XGetGeometry(f->display, f->window, &root, &x, &y, &width, &height, &border, &depth)) return;
+    // The position is relative to the parent, e.g. the window manager's frame
+    if (!XTranslateCoordinates(f->display, f->window, root, 0, 0, &x, &y, &child)) return;
+
+    f->screen = root_screen(f->display, root);
+    f->x = x;
+    f->y = y;
+    f->width = width;
+    f->height = height;
+}
+
+void focus_resolve(struct focus *f) {
+    if (!focus_stale(f)) return;
+
+    // The window may be gone by now. The error goes to the error handler, and is also queued for recovery.
+    unsigned long first = NextRequest(f->display);
+    if (f->changed_root != None) {
+        Window active = read_active(f, f->changed_root);
+        f->changed_root = None;
+        if (active != f->window) {
+            f->window = active;
+            f->moved = active != None;
+            f->screen = -1;
+            // Selected before locating so no move is missed. It is never deselected: bell attribution
+            // may be watching the same window, and selecting replaces the whole mask.
+            if (active != None && root_screen(f->display, active) < 0) {
+                XSelectInput(f->display, active, StructureNotifyMask);
+            }
+        }
+    }
+
+    if (f->moved) {
+        f->moved = false;
+        locate(f);
+        if (xerror_since(f->errors, first)) {
+            f->window = None;
+            f->screen = -1;
+        }
+    }
+}
@@ -0,0 +1,62 @@
+/*
+   xvisbell: visual bell for X11
+
+   Focus tracking: the active window (_NET_ACTIVE_WINDOW) and where it is, kept up to date from events
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_FOCUS_H
+#define XVISBELL_FOCUS_H
+
+#include "xerror.h"
+
+#include <X11/Xlib.h>
+
+#include <stdbool.h>
+
+struct focus {
+    Display *display;
+    struct xerrors *errors; // Where the errors of lookups turn up
+    Atom active_atom; // _NET_ACTIVE_WINDOW
+    Window changed_root; // Root window whose _NET_ACTIVE_WINDOW to read in focus_resolve, None if nothing changed
+
+    Window window; // The active window, None if the window manager doesn't say
+    bool moved; // Whether the window may have moved since it was last located
+    int screen; // Where the window is, screen -1 if that isn't known
+    int x, y; // Relative to the screen's root window
+    unsigned int width, height;
+};
+
+/*
+ * Start tracking the active window by watching _NET_ACTIVE_WINDOW on every root window
+ * Events already selected on the root windows are kept. Takes a round trip for each screen.
+ * Nothing is known until the first focus_resolve. Errors on the display must reach errors (see xerror_event).
+ */
+void focus_init(struct focus *f, Display *display, struct xerrors *errors);
+
+/*
+ * Note a change of the active window or its geometry
+ * Returns true if the event was only of interest to focus tracking.
+ * DestroyNotify returns false as the window may also be cached by others.
+ */
+bool focus_event(struct focus *f, XEvent *ev);
+
+// Forget the active window if it is window, which no longer exists (e.g. after an X error about it)
+void focus_forget(struct focus *f, Window window);
+
+// Whether the active window or where it is may have changed since the last focus_resolve
+static inline bool focus_stale(const struct focus *f) {
+    return f->changed_root != None || f->moved;
+}
+
+/*
+ * Look up the active window and where it is, if either may have changed since the last call
+ * This takes round trips if so, so call it after flushing the flashes.
+ */
+void focus_resolve(struct focus *f);
+
+#endif
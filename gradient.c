@@ -0,0 +1,155 @@
+/*
+   xvisbell: visual bell for X11
+
+   Gradient generator: ARGB32 gradients and vignettes with SIMD kernels
+
+   Every gradient is a per-pixel weight w = a*x^2 + b*x + c, clamped to
+   [0, 1], where only c depends on the row. Each channel is then
+   from + (to - from) * w. The kernels evaluate this for 1, 4 or 8 pixels
+   at a time with the same float operations in the same order, so they
+   agree bit for bit. A full 8K screen is 33 million pixels, which is
+   where the vector kernels pay off.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "gradient.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GRADIENT_X86
+#include <immintrin.h>
+#endif
+
+const char *const gradient_kernel_names[GRADIENT_KERNELS] = {"scalar", "sse2", "avx2"};
+
+// Bit offset of alpha, red, green and blue in an ARGB32 pixel
+static const int channel_shift[4] = {24, 16, 8, 0};
+
+// Row weight and channel values shared by the kernels
+struct row {
+    float a, b, c; // w(x) = (a*x + b)*x + c
+    float from[4], delta[4]; // Per channel start value and to - from, in ARGB order
+};
+
+static void row_scalar(uint32_t *dst, unsigned int start, unsigned int end, const struct row *r) {
+    for (unsigned int x = start; x < end; x++) {
+        float xf = (float) x;
+        float w = (r->a * xf + r->b) * xf + r->c;
+        w = w < 0 ? 0 : w > 1 ? 1 : w;
+
+        uint32_t pixel = 0;
+        for (int i = 0; i < 4; i++) {
+            pixel |= (uint32_t) (int32_t) (r->from[i] + r->delta[i] * w + 0.5f) << channel_shift[i];
+        }
+        dst[x] = pixel;
+    }
+}
+
+#ifdef GRADIENT_X86
+__attribute__((target("sse2")))
+static void row_sse2(uint32_t *dst, unsigned int width, const struct row *r) {
+    __m128 a = _mm_set1_ps(r->a), b = _mm_set1_ps(r->b), c = _mm_set1_ps(r->c);
+    __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1), half = _mm_set1_ps(0.5f);
+    __m128 lanes = _mm_set_ps(3, 2, 1, 0);
+
+    unsigned int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128 xf = _mm_add_ps(_mm_set1_ps((float) x), lanes);
+        __m128 w = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(a, xf), b), xf), c);
+        w = _mm_min_ps(_mm_max_ps(w, zero), one);
+
+        __m128i pixels = _mm_setzero_si128();
+        for (int i = 0; i < 4; i++) {
+            __m128 v = _mm_add_ps(_mm_add_ps(_mm_set1_ps(r->from[i]), _mm_mul_ps(_mm_set1_ps(r->delta[i]), w)), half);
+            pixels = _mm_or_si128(pixels, _mm_slli_epi32(_mm_cvttps_epi32(v), channel_shift[i]));
+        }
+        _mm_storeu_si128((__m128i *) &dst[x], pixels);
+    }
+    row_scalar(dst, x, width, r);
+}
+
+__attribute__((target("avx2")))
+static void row_avx2(uint32_t *dst, unsigned int width, const struct row *r) {
+    __m256 a = _mm256_set1_ps(r->a), b = _mm256_set1_ps(r->b), c = _mm256_set1_ps(r->c);
+    __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1), half = _mm256_set1_ps(0.5f);
+    __m256 lanes = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+
+    unsigned int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256 xf = _mm256_add_ps(_mm256_set1_ps((float) x), lanes);
+        __m256 w = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(a, xf), b), xf), c);
+        w = _mm256_min_ps(_mm256_max_ps(w, zero), one);
+
+        __m256i pixels = _mm256_setzero_si256();
+        for (int i = 0; i < 4; i++) {
+            __m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(r->from[i]),
+                                                   _mm256_mul_ps(_mm256_set1_ps(r->delta[i]), w)), half);
+            pixels = _mm256_or_si256(pixels, _mm256_slli_epi32(_mm256_cvttps_epi32(v), channel_shift[i]));
+        }
+        _mm256_storeu_si256((__m256i *) &dst[x], pixels);
+    }
+    row_scalar(dst, x, width, r);
+}
+#endif
+
+bool gradient_kernel_supported(enum gradient_kernel kernel) {
+    switch (kernel) {
+        case GRADIENT_SCALAR:
+            return true;
+#ifdef GRADIENT_X86
+        case GRADIENT_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case GRADIENT_AVX2:
+            // Also checks that the OS saves the AVX registers
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+enum gradient_kernel gradient_best_kernel(void) {
+    enum gradient_kernel kernel = GRADIENT_KERNELS - 1;
+    while (!gradient_kernel_supported(kernel)) kernel--;
+    return kernel;
+}
+
+void gradient_fill(uint32_t *pixels, size_t stride, unsigned int width, unsigned int height,
+                   enum gradient_kind kind, uint32_t from, uint32_t to, enum gradient_kernel kernel) {
+    struct row r = {0, 0, 0, {0}, {0}};
+    for (int i = 0; i < 4; i++) {
+        r.from[i] = (from >> channel_shift[i]) & 0xff;
+        r.delta[i] = (float) ((to >> channel_shift[i]) & 0xff) - r.from[i];
+    }
+
+    // Centre of the vignette, at least 1 so 1 pixel wide buffers don't divide by 0
+    float cx = width > 2 ? (width - 1) / 2.0f : 1, cy = height > 2 ? (height - 1) / 2.0f : 1;
+    if (kind == GRADIENT_HORIZONTAL) r.b = width > 1 ? 1.0f / (width - 1) : 0;
+    else if (kind == GRADIENT_VIGNETTE) {
+        // ((x - cx) / cx)^2 / 2 expanded, plus the row's share in c
+        r.a = 1 / (2 * cx * cx);
+        r.b = -1 / cx;
+    }
+
+    for (unsigned int y = 0; y < height; y++) {
+        if (kind == GRADIENT_VERTICAL) r.c = height > 1 ? (float) y / (height - 1) : 0;
+        else if (kind == GRADIENT_VIGNETTE) r.c = 0.5f + ((y - cy) / cy) * ((y - cy) / cy) / 2;
+
+        uint32_t *row = pixels + y * stride;
+        switch (kernel) {
+#ifdef GRADIENT_X86
+            case GRADIENT_SSE2:
+                row_sse2(row, width, &r);
+                break;
+            case GRADIENT_AVX2:
+                row_avx2(row, width, &r);
+                break;
+#endif
+            default:
+                row_scalar(row, 0, width, &r);
+        }
+    }
+}
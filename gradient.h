@@ -0,0 +1,48 @@
+/*
+   xvisbell: visual bell for X11
+
+   Gradient generator: ARGB32 gradients and vignettes with SIMD kernels
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_GRADIENT_H
+#define XVISBELL_GRADIENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum gradient_kind {
+    GRADIENT_HORIZONTAL, // from on the left to to on the right
+    GRADIENT_VERTICAL, // from at the top to to at the bottom
+    GRADIENT_VIGNETTE, // from in the centre to to in the corners
+};
+
+// Implementations of the row kernel, from slowest to fastest
+enum gradient_kernel {
+    GRADIENT_SCALAR,
+    GRADIENT_SSE2,
+    GRADIENT_AVX2,
+    GRADIENT_KERNELS // Number of kernels
+};
+
+extern const char *const gradient_kernel_names[GRADIENT_KERNELS];
+
+// Whether this build and CPU can run kernel
+bool gradient_kernel_supported(enum gradient_kernel kernel);
+
+// The fastest kernel this CPU supports
+enum gradient_kernel gradient_best_kernel(void);
+
+/*
+ * Fill a width x height ARGB32 buffer (stride pixels between rows) with a gradient between two ARGB colours
+ * Every kernel produces exactly the same pixels.
+ */
+void gradient_fill(uint32_t *pixels, size_t stride, unsigned int width, unsigned int height,
+                   enum gradient_kind kind, uint32_t from, uint32_t to, enum gradient_kernel kernel);
+
+#endif
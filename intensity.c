@@ -0,0 +1,65 @@
+/*
+   xvisbell: visual bell for X11
+
+   Flash intensity: lookup tables from a bell's volume and pitch to the flash's opacity and colour
+
+   Everything is worked out once at startup, including allocating the
+   colours, so handling a bell only indexes a table (or binary searches
+   the pitch steps) and never talks to the server.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "intensity.h"
+#include "visual.h"
+
+#include <math.h>
+
+void intensity_init_opacity(struct intensity *in, unsigned long min_percent) {
+    for (int percent = 0; percent <= 100; percent++) {
+        double opacity = (min_percent + (100 - min_percent) * percent / 100.0) / 100;
+        in->opacity[percent] = (unsigned long) (opacity * 0xffffffffUL);
+    }
+}
+
+bool intensity_init_ramp(struct intensity *in, Display *display, int screen, const XColor *low, const XColor *high) {
+    Colormap colormap = XDefaultColormap(display, screen);
+    Visual *visual = XDefaultVisual(display, screen);
+    double octaves = log2((double) INTENSITY_HIGH_PITCH / INTENSITY_LOW_PITCH);
+
+    for (int i = 0; i < INTENSITY_RAMP; i++) {
+        double t = (double) i / (INTENSITY_RAMP - 1);
+        in->pitches[i] = i == 0 ? 0 : (int) (INTENSITY_LOW_PITCH * pow(2, octaves * (i - 0.5) / (INTENSITY_RAMP - 1)));
+
+        XColor color = {
+            .red = low->red + (high->red - low->red) * t,
+            .green = low->green + (high->green - low->green) * t,
+            .blue = low->blue + (high->blue - low->blue) * t,
+        };
+        if (visual->class == TrueColor) {
+            in->pixels[i] = visual_pixel(visual, &color);
+        } else {
+            // Other visuals need the server to allocate each colour, one round trip apiece
+            if (!XAllocColor(display, colormap, &color)) return true;
+            in->pixels[i] = color.pixel;
+        }
+    }
+    in->ramp = true;
+    return false;
+}
+
+unsigned long intensity_pixel(const struct intensity *in, int pitch, unsigned long fallback) {
+    if (!in->ramp || pitch <= 0) return fallback;
+
+    // Find the last step whose lowest pitch is at most pitch
+    int lo = 0, hi = INTENSITY_RAMP - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (in->pitches[mid] <= pitch) lo = mid;
+        else hi = mid - 1;
+    }
+    return in->pixels[lo];
+}
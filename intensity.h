@@ -0,0 +1,49 @@
+/*
+   xvisbell: visual bell for X11
+
+   Flash intensity: lookup tables from a bell's volume and pitch to the flash's opacity and colour
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_INTENSITY_H
+#define XVISBELL_INTENSITY_H
+
+#include <X11/Xlib.h>
+
+#include <stdbool.h>
+
+#define INTENSITY_RAMP 64 // Colours in the pitch ramp
+#define INTENSITY_LOW_PITCH 100 // Pitches in Hz at the two ends of the ramp, spaced evenly in octaves between
+#define INTENSITY_HIGH_PITCH 3200
+
+struct intensity {
+    unsigned long opacity[101]; // _NET_WM_WINDOW_OPACITY for each volume percent
+    bool ramp; // Whether pitch picks the colour
+    unsigned long pixels[INTENSITY_RAMP]; // Colours from low to high pitch
+    int pitches[INTENSITY_RAMP]; // Lowest pitch that gets each colour
+};
+
+// Fill in the opacities, from min_percent for the quietest bell to opaque for the loudest
+void intensity_init_opacity(struct intensity *in, unsigned long min_percent);
+
+/*
+ * Allocate a ramp of colours from low (for low pitches) to high
+ * Returns true if a colour couldn't be allocated
+ */
+bool intensity_init_ramp(struct intensity *in, Display *display, int screen, const XColor *low, const XColor *high);
+
+static inline unsigned long intensity_opacity(const struct intensity *in, int percent) {
+    return in->opacity[percent < 0 ? 0 : percent > 100 ? 100 : percent];
+}
+
+/*
+ * Look up the colour for a pitch
+ * Returns fallback if there is no ramp or the bell has no pitch
+ */
+unsigned long intensity_pixel(const struct intensity *in, int pitch, unsigned long fallback);
+
+#endif
@@ -0,0 +1,53 @@
+/*
+   xvisbell: visual bell for X11
+
+   Server lag tracking: how far behind the X server is in processing our requests
+
+   Waiting for a reply would block the event loop, so instead a zero length
+   append to a property of our own window follows the flash requests. The
+   server answers it with a PropertyNotify once it has processed everything
+   before it, so while that event hasn't arrived the server is still
+   working through our requests and the marker's age is how far behind it is.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "lag.h"
+#include "xvisbell.h"
+
+#include <X11/Xatom.h>
+
+void lag_init(struct lag *l, Display *display, struct stats *stats, int screen, uint64_t max_ns) {
+    XSetWindowAttributes attrs;
+    attrs.event_mask = PropertyChangeMask;
+
+    l->display = display;
+    l->stats = stats;
+    l->serial = 0;
+    l->max_ns = max_ns;
+    l->window = XCreateWindow(display, XRootWindow(display, screen), -1, -1, 1, 1, 0, 0, InputOnly,
+                              CopyFromParent, CWEventMask, &attrs);
+}
+
+void lag_mark(struct lag *l) {
+    if (l->serial) return;
+
+    l->serial = NextRequest(l->display);
+    l->sent_ns = monotonic_ns();
+    // Any predefined atom works since nobody else looks at this window, and interning one would be a round trip
+    XChangeProperty(l->display, l->window, XA_WM_NAME, XA_STRING, 8, PropModeAppend, NULL, 0);
+}
+
+bool lag_event(struct lag *l, XEvent *ev) {
+    if (ev->type != PropertyNotify || ev->xproperty.window != l->window) return false;
+
+    // Older markers can't be outstanding, only one is sent at a time
+    if (l->serial && ev->xproperty.serial >= l->serial) {
+        histogram_observe(&l->stats->server_lag, monotonic_ns() - l->sent_ns);
+        l->serial = 0;
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+/*
+   xvisbell: visual bell for X11
+
+   Server lag tracking: how far behind the X server is in processing our requests
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_LAG_H
+#define XVISBELL_LAG_H
+
+#include "xvisbell.h"
+
+#include <X11/Xlib.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct lag {
+    Display *display;
+    struct stats *stats; // Where the lag is recorded
+    Window window; // Unmapped window whose property changes mark our place in the request stream
+    unsigned long serial; // Request number of the outstanding marker, 0 if none
+    uint64_t sent_ns; // When the outstanding marker was flushed
+    uint64_t max_ns; // Lag beyond which the server counts as overloaded
+};
+
+// Create the marker window, recording the lag in stats
+void lag_init(struct lag *l, Display *display, struct stats *stats, int screen, uint64_t max_ns);
+
+/*
+ * Queue a marker after the requests issued so far, unless one is already outstanding
+ * Call it just before flushing.
+ */
+void lag_mark(struct lag *l);
+
+/*
+ * Check whether ev is the server's answer to a marker, recording the lag if so
+ * Returns true if the event was a marker and needs no further handling
+ */
+bool lag_event(struct lag *l, XEvent *ev);
+
+// Whether the outstanding marker has been waiting longer than max_ns
+static inline bool lag_exceeded(const struct lag *l, uint64_t now) {
+    return l->serial && now - l->sent_ns > l->max_ns;
+}
+
+#endif
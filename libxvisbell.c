@@ -0,0 +1,552 @@
+/*
+   xvisbell: visual bell for X11
+
+   libxvisbell: the visual bell as a library, for programs with their own event loop
+
+   The xvisbell daemon is one host of this; bells, flashes, targets and the
+   scheduler all live here, while the daemon adds everything around them
+   (actions, recording, sound, the control socket and threads).
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "libxvisbell.h"
+#include "probes.h"
+#include "trace.h"
+#include "visual.h"
+#include "xvisbell.h"
+
+#ifdef HAVE_XINERAMA
+#include <X11/extensions/Xinerama.h>
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Set v->error. Returns true so failures can return it.
+static bool fail(struct xvisbell *v, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(v->error, sizeof(v->error), format, args);
+    va_end(args);
+    return true;
+}
+
+static void on_hide(struct sched_flash *hidden, bool expired, void *data);
+
+void xvisbell_init(struct xvisbell *v, Display *display, const struct xvisbell_config *config) {
+    memset(v, 0, sizeof(*v));
+    v->display = display;
+    v->config = *config;
+    v->xkb_event_base = -1;
+    v->own_stats = (struct stats) STATS_INIT;
+    v->stats = config->stats ? config->stats : &v->own_stats;
+    v->sched = (struct scheduler){.max = config->max_flashes, .hide = on_hide, .hide_data = v, .stats = v->stats};
+    xerror_init(&v->errors, display, v->stats, config->trace);
+    clients_init(&v->clients, display, &v->errors, v->stats, config->client_rate);
+}
+
+bool xvisbell_listen(struct xvisbell *v) {
+    int major = XkbMajorVersion;
+    int minor = XkbMinorVersion;
+
+    if (!XkbLibraryVersion(&major, &minor)) return fail(v, "X server doesn't support Xkb extension");
+
+    major = XkbMajorVersion;
+    minor = XkbMinorVersion;
+
+    if (!XkbQueryExtension(v->display, NULL, &v->xkb_event_base, NULL, &major, &minor)) {
+        return fail(v, "X server has wrong version of Xkb extension (try rebuilding xvisbell)");
+    }
+    XkbSelectEvents(v->display, XkbUseCoreKbd, XkbBellNotifyMask, XkbBellNotifyMask);
+    return false;
+}
+
+/*
+ * Work out the pixel value of a numeric colour (#rgb or rgb:r/g/b) on a TrueColor visual without a round trip
+ * Returns false if the colour has to be allocated by the server
+ */
+static bool local_pixel(Display *display, int screen, const char *color, unsigned long *pixel) {
+    Visual *visual = XDefaultVisual(display, screen);
+    if (visual->class != TrueColor) return false;
+    // XParseColor only contacts the server to look up colour names
+    if (color[0] != '#' && strncmp(color, "rgb:", 4) != 0) return false;
+
+    XColor rgb;
+    if (!XParseColor(display, XDefaultColormap(display, screen), color, &rgb)) return false;
+
+    *pixel = visual_pixel(visual, &rgb);
+    return true;
+}
+
+// Generate the gradient texture at the size of the flash, the largest on the screen being its whole area
+static bool setup_gradient(struct xvisbell *v, int screen) {
+    Display *display = v->display;
+    struct xvisbell_screen *s = &v->screens[screen];
+    struct xvisbell_target *t = &v->targets[screen];
+    Colormap colormap = XDefaultColormap(display, screen);
+    const char *names[2] = {v->config.gradient_from, v->config.color ? v->config.color : "white"};
+    uint32_t argb[2];
+
+    for (int i = 0; i < 2; i++) {
+        XColor rgb;
+        if (!XParseColor(display, colormap, names[i], &rgb)) return fail(v, "Colour %s isn't supported", names[i]);
+        argb[i] = 0xff000000 | (rgb.red >> 8) << 16 | (rgb.green >> 8) << 8 | rgb.blue >> 8;
+    }
+
+    if (texture_create(&s->texture, display, &v->errors, v->stats, screen, t->width, t->height)
+        || texture_fill_gradient(&s->texture, v->config.gradient_kind, argb[0], argb[1])) {
+        return fail(v, "Error creating a %ux%u gradient. It needs a TrueColor display", t->width, t->height);
+    }
+    texture_upload(&s->texture);
+    return false;
+}
+
+// Work out the colours of the pitch ramp
+static bool setup_pitch_ramp(struct xvisbell *v, int screen) {
+    Display *display = v->display;
+    Colormap colormap = XDefaultColormap(display, screen);
+    const char *names[2] = {v->config.pitch_ramp, v->config.color ? v->config.color : "white"};
+    XColor rgb[2];
+
+    for (int i = 0; i < 2; i++) {
+        if (!XParseColor(display, colormap, names[i], &rgb[i])) return fail(v, "Colour %s isn't supported", names[i]);
+    }
+    if (intensity_init_ramp(&v->screens[screen].intensity, display, screen, &rgb[0], &rgb[1])) {
+        return fail(v, "Error allocating the colours from %s to %s", names[0], names[1]);
+    }
+    return false;
+}
+
+// Set up a target for an area, placing the flash in it
+static void set_target(struct xvisbell *v, struct xvisbell_target *t, int screen,
+                       int x, int y, unsigned int width, unsigned int height) {
+    t->screen = screen;
+    t->area = (XRectangle){x, y, width, height};
+    t->x = x + v->config.x;
+    t->y = y + v->config.y;
+    t->width = v->config.width < 0 ? width : (unsigned int) v->config.width;
+    t->height = v->config.height < 0 ? height : (unsigned int) v->config.height;
+}
+
+// Work out where bells can flash: every screen and, if Xinerama merges several monitors into one, every monitor
+static bool setup_targets(struct xvisbell *v) {
+    Display *display = v->display;
+    int screens = ScreenCount(display), monitors = 0;
+#ifdef HAVE_XINERAMA
+    XineramaScreenInfo *info = NULL;
+    if (XineramaIsActive(display)) info = XineramaQueryScreens(display, &monitors);
+    if (info == NULL || monitors < 2) monitors = 0;
+#endif
+
+    v->screens = calloc(screens, sizeof(struct xvisbell_screen));
+    // One more for the active window with follow_focus
+    v->targets = calloc(screens + monitors + 1, sizeof(struct xvisbell_target));
+    if (v->screens == NULL || v->targets == NULL) return fail(v, "Error allocating flashes for %d screens", screens);
+    for (int i = 0; i < screens; i++) {
+        set_target(v, &v->targets[i], i, 0, 0, DisplayWidth(display, i), DisplayHeight(display, i));
+    }
+#ifdef HAVE_XINERAMA
+    // Xinerama only ever reports monitors of the one screen it makes
+    for (int i = 0; i < monitors; i++) {
+        set_target(v, &v->targets[screens + i], 0, info[i].x_org, info[i].y_org, info[i].width, info[i].height);
+    }
+    if (info) XFree(info);
+#endif
+    v->n_targets = screens + monitors;
+    return false;
+}
+
+// Allocate the colour and create the first pooled windows (or the overlay) of a screen
+static bool setup_screen(struct xvisbell *v, int screen) {
+    Display *display = v->display;
+    const struct xvisbell_config *config = &v->config;
+    struct xvisbell_screen *s = &v->screens[screen];
+    struct xvisbell_target *t = &v->targets[screen];
+
+    // Set background colour
+    if (config->color == NULL || strncmp(config->color, "white", 5) == 0) {
+        s->pixel = WhitePixel(display, screen);
+    } else if (local_pixel(display, screen, config->color, &s->pixel)) {
+        // Worked out without asking the server
+    } else {
+        XColor rgb, nearest;
+        if (!XAllocNamedColor(display, XDefaultColormap(display, screen), config->color, &rgb, &nearest)) {
+            return fail(v, "Colour %s isn't supported", config->color);
+        }
+        s->pixel = nearest.pixel;
+    }
+
+    if (config->renderer == XVISBELL_RENDERER_OVERLAY) {
+#ifndef HAVE_RENDER
+        return fail(v, "xvisbell was built without the overlay renderer. Rebuild it with make RENDER=1");
+#endif
+        XColor rgb = {.red = 0xffff, .green = 0xffff, .blue = 0xffff};
+        if (config->color) XParseColor(display, XDefaultColormap(display, screen), config->color, &rgb);
+        s->overlay = malloc(sizeof(struct overlay));
+        if (s->overlay == NULL) return fail(v, "Error allocating the overlay of screen %d", screen);
+        if (overlay_init(s->overlay, display, screen, &rgb, config->opacity * 0xffff / 100)) {
+            return fail(v, "X server doesn't support the Composite, Render and XFixes extensions needed by"
+                        " --renderer overlay");
+        }
+        return false;
+    }
+
+    // The image is uploaded once; every flash after that only maps a window
+    if (config->image_path
+        && texture_load_ppm(&s->texture, display, &v->errors, v->stats, screen, config->image_path)) {
+        return fail(v, "Error loading %s. It must be a binary PPM (P6) with 8 bit channels on a TrueColor display",
+                    config->image_path);
+    }
+    if (config->gradient && setup_gradient(v, screen)) return true;
+    pool_init(&s->pool, display, v->stats, screen, config->pool_size, t->x, t->y, t->width, t->height, s->pixel,
+              config->image_path || config->gradient ? s->texture.pixmap : None);
+    // Every colour and opacity a bell can ask for is worked out now, so bells never wait on the server
+    if (config->intensity || config->opacity < 100) {
+        s->pool.opacity_atom = XInternAtom(display, "_NET_WM_WINDOW_OPACITY", False);
+        intensity_init_opacity(&s->intensity, config->min_opacity);
+    }
+    if (config->pitch_ramp && setup_pitch_ramp(v, screen)) return true;
+    return false;
+}
+
+// Work out where bells can flash and create the resources of every screen, so routing a bell never waits
+static bool setup_flash(struct xvisbell *v) {
+    Display *display = v->display;
+
+    // The overlay window is shared with any compositor, whose output it is, so use windows instead then
+    if (v->config.renderer == XVISBELL_RENDERER_OVERLAY) {
+        for (int i = 0; i < ScreenCount(display); i++) {
+            if (overlay_compositor_running(display, i)) v->config.renderer = XVISBELL_RENDERER_WINDOW;
+        }
+    }
+    if (setup_targets(v)) return true;
+    for (int i = 0; i < ScreenCount(display); i++) {
+        if (setup_screen(v, i)) return true;
+    }
+    // Only worth the round trips when there is somewhere other than the default screen to flash
+    // and it isn't the focus that decides
+    v->clients.locate = v->n_targets > 1 && !v->config.follow_focus;
+    if (v->config.follow_focus) focus_init(&v->focus, display, &v->errors);
+    if (v->config.max_lag_ns) lag_init(&v->lag, display, v->stats, XDefaultScreen(display), v->config.max_lag_ns);
+    v->ready = true;
+    return false;
+}
+
+bool xvisbell_setup(struct xvisbell *v) {
+    if (v->config.lazy) return false;
+    return setup_flash(v);
+}
+
+void xvisbell_free(struct xvisbell *v) {
+    if (v->xkb_event_base >= 0) XkbSelectEvents(v->display, XkbUseCoreKbd, XkbBellNotifyMask, 0);
+    for (int i = 0; v->screens && i < ScreenCount(v->display); i++) {
+        struct xvisbell_screen *s = &v->screens[i];
+        if (v->ready && v->config.renderer == XVISBELL_RENDERER_OVERLAY) {
+            overlay_free(s->overlay);
+        } else if (v->ready) {
+            pool_free(&s->pool);
+            texture_free(&s->texture);
+        }
+        // Also allocated for a screen whose setup failed
+        free(s->overlay);
+    }
+    if (v->ready && v->config.max_lag_ns) XDestroyWindow(v->display, v->lag.window);
+    XFlush(v->display);
+    free(v->screens);
+    free(v->targets);
+    v->screens = NULL;
+    v->targets = NULL;
+    v->ready = false;
+}
+
+static void on_hide(struct sched_flash *hidden, bool expired, void *data) {
+    struct xvisbell *v = data;
+
+    if (expired) {
+        uint64_t late = monotonic_ns() - hidden->end_ns;
+        trace(v->config.trace, TRACE_TIMER, late / 1000);
+        PROBE1(timer, late);
+    }
+    trace(v->config.trace, TRACE_UNMAP, hidden->key);
+    PROBE1(unmap, hidden->window);
+    struct xvisbell_target *t = &v->targets[hidden->key];
+    struct xvisbell_screen *s = &v->screens[t->screen];
+    if (v->config.renderer == XVISBELL_RENDERER_OVERLAY) {
+        overlay_hide(s->overlay, t->x, t->y, t->width, t->height);
+    } else {
+        XUnmapWindow(v->display, hidden->window);
+        pool_release(&s->pool, hidden->window);
+    }
+}
+
+// Hide the flashes whose time is up
+static void hide_expired(struct xvisbell *v) {
+    if (sched_expire(&v->sched, monotonic_ns()) == 0) return;
+
+    STAT_SET(v->stats, visible, v->sched.n);
+    stats_changed(v->stats);
+}
+
+/*
+ * Show (or extend) the flash on target in a pooled window or on the overlay
+ * pixel and opacity are only used by pooled windows: an extended one takes the new bell's colour and the higher
+ * of the two opacities, so a louder bell isn't hidden behind a quieter one's flash.
+ * Returns false if there was no room for it
+ */
+static bool show_flash(struct xvisbell *v, int target, int priority, uint64_t end_ns,
+                       unsigned long pixel, unsigned long opacity) {
+    int i = sched_find(&v->sched, target);
+    // 0 starts a new flash, 1 extends the visible one
+    PROBE1(dispatch, i >= 0);
+    unsigned long first = NextRequest(v->display);
+    if (i >= 0) {
+        // Keep it above anything mapped since it was shown. The overlay is always on top.
+        if (v->config.renderer == XVISBELL_RENDERER_WINDOW) {
+            Window window = v->sched.heap[i].window;
+            XRaiseWindow(v->display, window);
+            pool_restyle(&v->screens[v->targets[target].screen].pool, window, pixel, opacity);
+            xerror_tag(&v->errors, first, target, window);
+        }
+        sched_extend(&v->sched, i, priority, end_ns);
+        STAT_ADD(v->stats, extended, 1);
+        return true;
+    }
+
+    if (!sched_make_room(&v->sched, priority)) return false;
+    struct xvisbell_target *t = &v->targets[target];
+    struct xvisbell_screen *s = &v->screens[t->screen];
+    Window window;
+    if (v->config.renderer == XVISBELL_RENDERER_OVERLAY) {
+        window = s->overlay->window;
+        overlay_show(s->overlay, t->x, t->y, t->width, t->height);
+    } else {
+        window = pool_acquire(&s->pool, t->x, t->y, t->width, t->height, pixel, opacity);
+        if (window == None) return false;
+        XMapRaised(v->display, window);
+    }
+    // If any of it fails the flash is dropped
+    xerror_tag(&v->errors, first, target, window);
+
+    sched_add(&v->sched, target, window, priority, end_ns);
+    STAT_ADD(v->stats, flashes, 1);
+    trace(v->config.trace, TRACE_MAP, target);
+    PROBE1(map, window);
+    return true;
+}
+
+// Get the monitor (or screen) with the centre of a window
+static int monitor_at(struct xvisbell *v, int screen, int x, int y, unsigned int width, unsigned int height) {
+    x += (int) width / 2;
+    y += (int) height / 2;
+    for (int i = ScreenCount(v->display); i < v->n_targets; i++) {
+        struct xvisbell_target *t = &v->targets[i];
+        if (t->screen == screen && x >= t->area.x && x < t->area.x + t->area.width
+            && y >= t->area.y && y < t->area.y + t->area.height) return i;
+    }
+    return screen;
+}
+
+/*
+ * Pick where a bell rung on window flashes: with follow_focus the active window or its monitor,
+ * otherwise the monitor (or screen) the window was on when its client was resolved.
+ * Falls back to the whole default screen if that isn't known yet. Only cached geometry is used.
+ */
+static int route(struct xvisbell *v, Window window) {
+    const struct focus *f = &v->focus;
+    if (v->config.follow_focus == XVISBELL_FOLLOW_MONITOR && f->screen >= 0) {
+        return monitor_at(v, f->screen, f->x, f->y, f->width, f->height);
+    }
+    if (v->config.follow_focus == XVISBELL_FOLLOW_WINDOW && f->screen >= 0) {
+        int target = v->n_targets;
+        // A visible flash stays where it was drawn so it is hidden from there, the next one follows the window
+        if (sched_find(&v->sched, target) < 0) {
+            set_target(v, &v->targets[target], f->screen, f->x, f->y, f->width, f->height);
+        }
+        return target;
+    }
+    if (v->config.follow_focus) return XDefaultScreen(v->display);
+
+    const struct client_window *w = clients_window(&v->clients, window);
+    if (w == NULL || w->screen < 0) return XDefaultScreen(v->display);
+    return monitor_at(v, w->screen, w->x, w->y, w->width, w->height);
+}
+
+/*
+ * Get the priority of a bell's flash, for when there is no room for every flash: louder bells win,
+ * and with follow_focus a bell from the active window beats any other
+ */
+static int bell_priority(const struct xvisbell *v, const XkbBellNotifyEvent *ev) {
+    int priority = ev->percent < 0 ? 0 : ev->percent > 100 ? 100 : ev->percent;
+    if (v->config.follow_focus && ev->window != None && ev->window == v->focus.window) priority += 101;
+    return priority;
+}
+
+// Flash for a bell that is allowed through, now that it can be routed
+static void flash(struct xvisbell *v, XkbBellNotifyEvent *ev, uint64_t recv_ns) {
+    int target = route(v, ev->window);
+    struct xvisbell_screen *s = &v->screens[v->targets[target].screen];
+    uint64_t now = monotonic_ns();
+    uint64_t duration = v->config.duration_ns;
+    unsigned long opacity = POOL_OPAQUE;
+    if (v->config.opacity < 100) opacity = (unsigned long) (v->config.opacity / 100.0 * POOL_OPAQUE);
+    if (v->config.intensity) {
+        // The bell's own duration only ever makes the flash longer than configured
+        if (ev->duration > 0 && ev->duration * 1000000ULL > duration) duration = ev->duration * 1000000ULL;
+        opacity = intensity_opacity(&s->intensity, ev->percent);
+    }
+    uint64_t end_ns = now + duration;
+    int priority = bell_priority(v, ev);
+    if (v->config.max_lag_ns && lag_exceeded(&v->lag, now)) {
+        // More requests would only queue behind the ones the server hasn't got to yet
+        int i = sched_find(&v->sched, target);
+        if (i >= 0) {
+            // Keep the visible flash up for this bell too, without raising it again
+            sched_extend(&v->sched, i, priority, end_ns);
+            STAT_ADD(v->stats, backpressure_merged, 1);
+        } else {
+            STAT_ADD(v->stats, backpressure_dropped, 1);
+        }
+        stats_changed(v->stats);
+    } else if (show_flash(v, target, priority, end_ns, intensity_pixel(&s->intensity, ev->pitch, s->pixel), opacity)) {
+        if (v->unflushed_since == 0) v->unflushed_since = recv_ns;
+        STAT_SET(v->stats, visible, v->sched.n);
+        stats_changed(v->stats);
+    }
+
+    if (v->config.on_bell) v->config.on_bell(ev, recv_ns, false, v->config.on_bell_data);
+}
+
+bool xvisbell_bell(struct xvisbell *v, XkbBellNotifyEvent *ev, uint64_t recv_ns) {
+    trace(v->config.trace, TRACE_BELL, ev->percent);
+    PROBE2(bell, ev->percent, ev->time);
+    STAT_ADD(v->stats, bells, 1);
+
+    if (!clients_bell(&v->clients, ev->window, recv_ns)) {
+        stats_changed(v->stats);
+        if (v->config.on_bell) v->config.on_bell(ev, recv_ns, true, v->config.on_bell_data);
+        return false;
+    }
+
+    if (!v->ready && setup_flash(v)) return true;
+
+    // Routed by a window that isn't located yet (or has moved), or by the focus before the change read along with
+    // the bell, the flash would go to the wrong screen or monitor, so it waits for the lookups in xvisbell_flush
+    const struct client_window *w = clients_window(&v->clients, ev->window);
+    bool unlocated = v->config.follow_focus ? focus_stale(&v->focus) : w && clients_unlocated(&v->clients, w);
+    if (unlocated && v->n_deferred < XVISBELL_DEFERRED) {
+        v->deferred[v->n_deferred++] = (struct xvisbell_deferred){*ev, recv_ns};
+        STAT_ADD(v->stats, bells_deferred, 1);
+        return false;
+    }
+
+    flash(v, ev, recv_ns);
+    return false;
+}
+
+// Send the queued requests and record how long the bells behind them waited
+static void send_requests(struct xvisbell *v) {
+    // Follow the flashes with a marker to find out when the server has got through them
+    if (v->config.max_lag_ns && v->unflushed_since) lag_mark(&v->lag);
+    XFlush(v->display);
+
+    if (v->unflushed_since) {
+        uint64_t now = monotonic_ns();
+        uint64_t latency = now - v->unflushed_since;
+        trace(v->config.trace, TRACE_FLUSH, latency / 1000);
+        if (STAT_GET(v->stats, first_flash_ns) == 0) STAT_SET(v->stats, first_flash_ns, now - v->config.start_ns);
+        histogram_observe(&v->stats->latency, latency);
+        v->unflushed_since = 0;
+    }
+}
+
+void xvisbell_flush(struct xvisbell *v) {
+    send_requests(v);
+
+    // The flashes have gone out, now there is time to find out who rang and where the focus went
+    clients_resolve(&v->clients);
+    if (v->config.follow_focus && v->ready) focus_resolve(&v->focus);
+    if (v->n_deferred) {
+        // Their windows (or the focus) have been located now
+        for (int i = 0; i < v->n_deferred; i++) flash(v, &v->deferred[i].ev, v->deferred[i].recv_ns);
+        v->n_deferred = 0;
+        send_requests(v);
+    }
+}
+
+bool xvisbell_x_error(struct xvisbell *v, Display *display, XErrorEvent *error) {
+    if (display != v->display) return false;
+    xerror_event(&v->errors, error);
+    return true;
+}
+
+/*
+ * Undo what failed requests were for, now that requests can be sent again
+ * Whatever is cached about a window that is gone is forgotten, and a flash whose requests failed is dropped.
+ */
+static void recover(struct xvisbell *v) {
+    struct xerror_failure f;
+    while (xerror_take(&v->errors, &f)) {
+        bool gone = f.code == BadWindow || f.code == BadDrawable;
+        if (gone) {
+            clients_forget(&v->clients, f.resource);
+            focus_forget(&v->focus, f.resource);
+            for (int i = 0; v->ready && i < ScreenCount(v->display); i++) pool_forget(&v->screens[i].pool, f.resource);
+        }
+        if (!f.tagged) continue;
+
+        // The flash may have been hidden, or replaced by a later one for the same target, since
+        int i = sched_find(&v->sched, f.tag.key);
+        if (i < 0 || v->sched.heap[i].window != f.tag.window) continue;
+        if (gone && f.resource == f.tag.window) {
+            // Nothing to unmap, but the flash still ends here in the trace
+            trace(v->config.trace, TRACE_UNMAP, f.tag.key);
+            sched_remove(&v->sched, i);
+        } else {
+            sched_hide(&v->sched, i);
+        }
+        STAT_ADD(v->stats, flashes_failed, 1);
+        STAT_SET(v->stats, visible, v->sched.n);
+        stats_changed(v->stats);
+    }
+}
+
+uint64_t xvisbell_next_deadline(const struct xvisbell *v) {
+    // Without a visible window there is nothing to time out
+    uint64_t deadline = UINT64_MAX, trim_deadline;
+    sched_next_deadline(&v->sched, &deadline);
+    for (int i = 0; v->ready && i < ScreenCount(v->display); i++) {
+        if (pool_trim_deadline(&v->screens[i].pool, &trim_deadline) && trim_deadline < deadline) {
+            deadline = trim_deadline;
+        }
+    }
+    return deadline;
+}
+
+bool xvisbell_dispatch(struct xvisbell *v) {
+    recover(v);
+    hide_expired(v);
+    uint64_t now = monotonic_ns();
+    for (int i = 0; v->ready && i < ScreenCount(v->display); i++) pool_trim(&v->screens[i].pool, now);
+
+    while (XPending(v->display)) {
+        XEvent ev;
+        XNextEvent(v->display, &ev);
+        if (v->config.max_lag_ns && v->ready && lag_event(&v->lag, &ev)) continue;
+        if (v->config.follow_focus && v->ready && focus_event(&v->focus, &ev)) continue;
+        if (clients_event(&v->clients, &ev)) continue;
+
+        if (ev.type != v->xkb_event_base || ((XkbEvent *) &ev)->any.xkb_type != XkbBellNotify) continue;
+        if (xvisbell_bell(v, &((XkbEvent *) &ev)->bell, monotonic_ns())) return true;
+    }
+    // Errors are read along with the events
+    recover(v);
+
+    xvisbell_flush(v);
+    return false;
+}
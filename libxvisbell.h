@@ -0,0 +1,215 @@
+/*
+   xvisbell: visual bell for X11
+
+   libxvisbell: the visual bell as a library, for programs with their own event loop
+
+   Everything lives in a struct xvisbell, so a program can host any number of
+   them. Wait for xvisbell_fd to be readable or for xvisbell_next_deadline,
+   whichever comes first, then call xvisbell_dispatch:
+
+       uint64_t deadline = xvisbell_next_deadline(&v);
+       poll() on xvisbell_fd(&v) until deadline (UINT64_MAX for no timeout)
+       if (xvisbell_dispatch(&v)) report xvisbell_error(&v)
+
+   Nothing is global: each context counts into its own stats (v->stats, see
+   xvisbell.h) and traces into the ring in its config, if any. Contexts can
+   share counters by pointing their configs at the same struct stats, which
+   is what the daemon does with its process-wide one.
+
+   Xlib has a single error handler per process, which belongs to the host.
+   It should pass the errors of the context's display to xvisbell_x_error,
+   so they are recovered from (e.g. a flash window destroyed by another
+   client is dropped) instead of being fatal. The library never installs a
+   handler of its own.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef LIBXVISBELL_H
+#define LIBXVISBELL_H
+
+#include "clients.h"
+#include "focus.h"
+#include "gradient.h"
+#include "intensity.h"
+#include "lag.h"
+#include "overlay.h"
+#include "pool.h"
+#include "sched.h"
+#include "texture.h"
+#include "trace.h"
+#include "xerror.h"
+#include "xvisbell.h"
+
+#include <X11/XKBlib.h>
+#include <X11/Xlib.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum xvisbell_renderer {
+    XVISBELL_RENDERER_WINDOW, // Map an override-redirect window
+    // Fill an area of the Composite overlay window with XRender. Set up as window if a compositor is running.
+    XVISBELL_RENDERER_OVERLAY,
+};
+
+// Where bells flash
+enum xvisbell_follow {
+    XVISBELL_FOLLOW_NONE, // The monitor or screen of the window that rang
+    XVISBELL_FOLLOW_WINDOW, // The active window
+    XVISBELL_FOLLOW_MONITOR, // The monitor or screen of the active window
+};
+
+/*
+ * Called for every bell once its flash has been queued, e.g. to play a sound
+ * limited is true if the bell's client was over client_rate and nothing was flashed.
+ */
+typedef void (*xvisbell_bell_fn)(XkbBellNotifyEvent *ev, uint64_t recv_ns, bool limited, void *data);
+
+// How flashes look and behave
+struct xvisbell_config {
+    int x, y; // Position of the flash within its screen or monitor
+    long width, height; // -1 to match the screen or monitor
+    const char *color; // X11 colour name, NULL for white
+    uint64_t duration_ns;
+    enum xvisbell_renderer renderer;
+    unsigned long opacity; // Percent. Windows get it as _NET_WM_WINDOW_OPACITY, which needs a compositor.
+    const char *image_path; // PPM image tiled over flash windows, NULL for a solid colour
+    bool gradient; // Whether to show a gradient from gradient_from to the colour instead
+    enum gradient_kind gradient_kind;
+    const char *gradient_from;
+    bool intensity; // Whether a bell's volume sets its opacity (from min_opacity percent) and its duration the minimum
+    unsigned long min_opacity;
+    const char *pitch_ramp; // Colour of the lowest pitched bells, ramping to color for the highest. NULL for one colour.
+    uint64_t max_lag_ns; // Server lag beyond which new flashes are merged or dropped, 0 to never hold back
+    unsigned long max_flashes; // At most SCHED_MAX_FLASHES
+    unsigned long pool_size; // Windows created up front and kept when idle, at most POOL_MAX_WINDOWS
+    unsigned long client_rate; // Bells per second each client may ring, 0 for no limit
+    enum xvisbell_follow follow_focus;
+    bool lazy; // Whether to create the windows on the first flash instead of in xvisbell_setup
+    uint64_t start_ns; // What the first_flash_ns stat is measured from, e.g. when the program started
+    struct stats *stats; // Where to count, e.g. shared with other contexts. NULL for the context's own.
+    struct trace_ring *trace; // Where to record a trace (needs TRACE=1), NULL for nowhere
+    xvisbell_bell_fn on_bell; // NULL if nothing else needs to happen for a bell
+    void *on_bell_data;
+};
+
+#define XVISBELL_CONFIG_DEFAULT {                                   \
+    .width = -1, .height = -1, .duration_ns = 100000000,            \
+    .renderer = XVISBELL_RENDERER_WINDOW, .opacity = 100,           \
+    .gradient_from = "black", .min_opacity = 30,                    \
+    .max_flashes = 16, .pool_size = 1,                              \
+}
+
+// The flash resources of one screen
+struct xvisbell_screen {
+    unsigned long pixel; // Background colour
+    struct window_pool pool; // Windows to show flashes in (window renderer)
+    // Where flashes are drawn (overlay renderer), NULL otherwise. Behind a pointer so the layout doesn't depend on RENDER.
+    struct overlay *overlay;
+    struct texture texture; // Background of the windows if there is an image or gradient
+    struct intensity intensity; // Opacity and colour of each bell, with intensity or a pitch_ramp
+};
+
+// Bells held back until their windows (or the focus) are located, later ones flash where they can
+#define XVISBELL_DEFERRED 32
+
+// A bell waiting for its window, or with follow_focus the active window, to be located
+struct xvisbell_deferred {
+    XkbBellNotifyEvent ev;
+    uint64_t recv_ns;
+};
+
+// Somewhere a bell can flash: a whole screen or, with Xinerama, one monitor
+struct xvisbell_target {
+    int screen;
+    XRectangle area; // The screen or monitor
+    int x, y; // The flash, placed in the area by the config's position and size
+    unsigned int width, height;
+};
+
+struct xvisbell {
+    Display *display; // Best kept to xvisbell, xvisbell_dispatch reads every event on it
+    struct xvisbell_config config;
+    int xkb_event_base; // -1 until xvisbell_listen
+    bool ready; // Whether the flash resources have been created
+    struct xvisbell_screen *screens; // One for each screen
+    struct xvisbell_target *targets; // Each screen's whole area, in screen order, then each monitor, then the active window
+    int n_targets; // Not counting the active window
+
+    struct lag lag; // How far behind the server is, if there is a max_lag_ns
+    struct clients clients; // Who rang the bells
+    struct focus focus; // The active window, with follow_focus
+    struct xerrors errors; // Requests that may fail, and the errors to recover from
+    struct scheduler sched; // Visible flashes and when to hide them, keyed by target
+    struct xvisbell_deferred deferred[XVISBELL_DEFERRED]; // Bells to flash once their windows or the focus are located
+    int n_deferred;
+    uint64_t unflushed_since; // When the oldest bell whose map request hasn't been sent was received, 0 if none
+    char error[256]; // Why the last call failed
+    struct stats *stats; // The config's stats, or own_stats
+    struct stats own_stats;
+};
+
+// Set up a context. Nothing is sent to the server yet.
+void xvisbell_init(struct xvisbell *v, Display *display, const struct xvisbell_config *config);
+
+/*
+ * Select Xkb bell events so xvisbell_dispatch flashes for them
+ * Takes a round trip. Returns true if the server lacks a compatible Xkb.
+ */
+bool xvisbell_listen(struct xvisbell *v);
+
+/*
+ * Create the windows (or overlay), colours and textures of every screen, unless the config is lazy
+ * Returns true on error, e.g. an unsupported colour
+ */
+bool xvisbell_setup(struct xvisbell *v);
+
+// Destroy everything created in the server and stop listening. The display is left open.
+void xvisbell_free(struct xvisbell *v);
+
+// Descriptor to wait on for reading
+static inline int xvisbell_fd(const struct xvisbell *v) {
+    return ConnectionNumber(v->display);
+}
+
+// Get when xvisbell_dispatch next has work to do even without events, UINT64_MAX if only events matter
+uint64_t xvisbell_next_deadline(const struct xvisbell *v);
+
+/*
+ * Hide expired flashes, flash for the bells that have arrived and send the requests
+ * Never blocks waiting for events. Returns true on error (from setting up lazily).
+ */
+bool xvisbell_dispatch(struct xvisbell *v);
+
+/*
+ * Flash for a bell that didn't come from the server, e.g. replayed or asked for by the host
+ * Requests are sent by the next xvisbell_dispatch or xvisbell_flush. Returns true on error.
+ * The first bell of a window on a display with several screens or monitors only flashes in xvisbell_flush,
+ * once it is known where the window is.
+ */
+bool xvisbell_bell(struct xvisbell *v, XkbBellNotifyEvent *ev, uint64_t recv_ns);
+
+// Send queued requests, then look up the clients of new windows and flash the bells that were waiting for them
+void xvisbell_flush(struct xvisbell *v);
+
+// Number of flashes on screen
+static inline int xvisbell_visible(const struct xvisbell *v) {
+    return v->sched.n;
+}
+
+/*
+ * Hand an X error to the context, from the host's error handler (see XSetErrorHandler)
+ * Returns false if it is about another display. Otherwise it is counted in the stats and recovered from
+ * by the next xvisbell_dispatch. Never sends requests.
+ */
+bool xvisbell_x_error(struct xvisbell *v, Display *display, XErrorEvent *error);
+
+static inline const char *xvisbell_error(const struct xvisbell *v) {
+    return v->error;
+}
+
+#endif
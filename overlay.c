@@ -0,0 +1,104 @@
+/*
+   xvisbell: visual bell for X11
+
+   Overlay renderer: flashes drawn with XRender on the Composite overlay window
+
+   Instead of mapping a window (which the window manager may see), the
+   overlay's bounding shape is set to the flashed areas and they are filled
+   with XRender. Every picture and region is created once at startup, so a
+   flash costs one SetWindowShapeRegion and one FillRectangles (plus one
+   Composite when translucent) and hiding it costs one SetWindowShapeRegion.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "overlay.h"
+
+#include <X11/extensions/Xcomposite.h>
+#include <X11/extensions/shape.h>
+
+#include <stdio.h>
+
+bool overlay_compositor_running(Display *display, int screen) {
+    char name[32];
+    snprintf(name, sizeof(name), "_NET_WM_CM_S%d", screen);
+    return XGetSelectionOwner(display, XInternAtom(display, name, False)) != None;
+}
+
+bool overlay_init(struct overlay *o, Display *display, int screen, const XColor *color, unsigned short opacity) {
+    int event_base, error_base;
+    if (!XCompositeQueryExtension(display, &event_base, &error_base)
+        || !XRenderQueryExtension(display, &event_base, &error_base)
+        || !XFixesQueryExtension(display, &event_base, &error_base)) {
+        return true;
+    }
+
+    Window root = XRootWindow(display, screen);
+    XRenderPictFormat *format = XRenderFindVisualFormat(display, XDefaultVisual(display, screen));
+
+    o->display = display;
+    o->window = XCompositeGetOverlayWindow(display, root);
+    o->n_rects = 0;
+    o->region = XFixesCreateRegion(display, NULL, 0);
+    // Without a background the overlay shows whatever was on screen where it is shaped in
+    XSetWindowBackgroundPixmap(display, o->window, None);
+    XFixesSetWindowShapeRegion(display, o->window, ShapeInput, 0, 0, o->region);
+    XFixesSetWindowShapeRegion(display, o->window, ShapeBounding, 0, 0, o->region);
+
+    o->picture = XRenderCreatePicture(display, o->window, format, 0, NULL);
+
+    XRenderPictureAttributes attrs = {.subwindow_mode = IncludeInferiors};
+    o->root_picture = XRenderCreatePicture(display, root, format, CPSubwindowMode, &attrs);
+
+    o->translucent = opacity < 0xffff;
+    o->color.alpha = opacity;
+    o->color.red = (unsigned long) color->red * opacity / 0xffff;
+    o->color.green = (unsigned long) color->green * opacity / 0xffff;
+    o->color.blue = (unsigned long) color->blue * opacity / 0xffff;
+    return false;
+}
+
+// Shape the overlay to the visible flashes
+static void update_shape(struct overlay *o) {
+    XFixesSetRegion(o->display, o->region, o->rects, o->n_rects);
+    XFixesSetWindowShapeRegion(o->display, o->window, ShapeBounding, 0, 0, o->region);
+}
+
+void overlay_show(struct overlay *o, int x, int y, unsigned int width, unsigned int height) {
+    if (o->n_rects == SCHED_MAX_FLASHES) return;
+    o->rects[o->n_rects++] = (XRectangle){x, y, width, height};
+    update_shape(o);
+
+    if (o->translucent) {
+        // Start from what is on screen so the colour is blended over it
+        XRenderComposite(o->display, PictOpSrc, o->root_picture, None, o->picture,
+                         x, y, 0, 0, x, y, width, height);
+        XRenderFillRectangle(o->display, PictOpOver, o->picture, &o->color, x, y, width, height);
+    } else {
+        XRenderFillRectangle(o->display, PictOpSrc, o->picture, &o->color, x, y, width, height);
+    }
+}
+
+void overlay_hide(struct overlay *o, int x, int y, unsigned int width, unsigned int height) {
+    for (int i = 0; i < o->n_rects; i++) {
+        XRectangle *r = &o->rects[i];
+        if (r->x == x && r->y == y && r->width == width && r->height == height) {
+            *r = o->rects[--o->n_rects];
+            break;
+        }
+    }
+    update_shape(o);
+}
+
+void overlay_free(struct overlay *o) {
+    // The overlay window is shared, so leave it as it was found for whoever gets it next
+    XFixesSetWindowShapeRegion(o->display, o->window, ShapeBounding, 0, 0, None);
+    XFixesSetWindowShapeRegion(o->display, o->window, ShapeInput, 0, 0, None);
+    XRenderFreePicture(o->display, o->picture);
+    XRenderFreePicture(o->display, o->root_picture);
+    XFixesDestroyRegion(o->display, o->region);
+    XCompositeReleaseOverlayWindow(o->display, o->window);
+}
@@ -0,0 +1,100 @@
+/*
+   xvisbell: visual bell for X11
+
+   Overlay renderer: flashes drawn with XRender on the Composite overlay window
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_OVERLAY_H
+#define XVISBELL_OVERLAY_H
+
+#include "sched.h"
+
+#include <X11/Xlib.h>
+#ifdef HAVE_RENDER
+#include <X11/extensions/Xfixes.h>
+#include <X11/extensions/Xrender.h>
+#endif
+
+#include <stdbool.h>
+
+#ifdef HAVE_RENDER
+struct overlay {
+    Display *display;
+    Window window; // The Composite overlay window
+    Picture picture; // Drawing target on the overlay window
+    Picture root_picture; // The screen contents, to blend translucent flashes over
+    XserverRegion region; // Reused to set the overlay's shape
+    XRenderColor color; // Premultiplied flash colour
+    bool translucent;
+
+    XRectangle rects[SCHED_MAX_FLASHES]; // Areas of the visible flashes
+    int n_rects;
+};
+
+/*
+ * Check whether a compositor is running on a screen (the _NET_WM_CM_Sn selection has an owner)
+ * The overlay window is the compositor's output then, and shaping it to the flashes would hide the rest of the screen.
+ */
+bool overlay_compositor_running(Display *display, int screen);
+
+/*
+ * Get the overlay window and create the pictures and region used by every flash
+ * The overlay starts with an empty shape so it is invisible and never takes input.
+ * opacity is 0 to 65535.
+ * Returns true if the server lacks the Composite, Render or XFixes extension.
+ */
+bool overlay_init(struct overlay *o, Display *display, int screen, const XColor *color, unsigned short opacity);
+
+// Draw a flash over the given area
+void overlay_show(struct overlay *o, int x, int y, unsigned int width, unsigned int height);
+
+// Remove a flash previously drawn over the given area
+void overlay_hide(struct overlay *o, int x, int y, unsigned int width, unsigned int height);
+
+// Give the overlay window its whole shape back, free the pictures and region and release the window
+void overlay_free(struct overlay *o);
+#else
+// Built without the overlay renderer (make RENDER=0), so it is never set up and these are never reached
+struct overlay {
+    Window window;
+};
+
+static inline bool overlay_compositor_running(Display *display, int screen) {
+    (void) display;
+    (void) screen;
+    return false;
+}
+
+static inline bool overlay_init(struct overlay *o, Display *display, int screen, const XColor *color,
+                                unsigned short opacity) {
+    (void) o;
+    (void) display;
+    (void) screen;
+    (void) color;
+    (void) opacity;
+    return true;
+}
+
+static inline void overlay_show(struct overlay *o, int x, int y, unsigned int width, unsigned int height) {
+    (void) o;
+    (void) x;
+    (void) y;
+    (void) width;
+    (void) height;
+}
+
+static inline void overlay_hide(struct overlay *o, int x, int y, unsigned int width, unsigned int height) {
+    overlay_show(o, x, y, width, height);
+}
+
+static inline void overlay_free(struct overlay *o) {
+    (void) o;
+}
+#endif
+
+#endif
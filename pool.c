@@ -0,0 +1,159 @@
+/*
+   xvisbell: visual bell for X11
+
+   Pool of pre-created flash windows
+
+   Flashes reuse unmapped windows instead of creating and destroying one each
+   time, so once the pool is warm a flash allocates nothing in the server.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "pool.h"
+#include "xvisbell.h"
+
+#include <X11/Xatom.h>
+
+static Window create(struct window_pool *p, int x, int y, unsigned int width, unsigned int height,
+                     unsigned long pixel) {
+    XSetWindowAttributes attrs;
+    attrs.override_redirect = True;
+    attrs.save_under = True;
+    attrs.background_pixel = pixel;
+    attrs.background_pixmap = p->background;
+
+    struct pool_window *w = &p->windows[p->size++];
+    *w = (struct pool_window){.x = x, .y = y, .width = width, .height = height, .pixel = pixel,
+                              .opacity = POOL_OPAQUE};
+    w->window = XCreateWindow(p->display, XRootWindow(p->display, p->screen), x, y,
+                              width, height, 0,
+                              XDefaultDepth(p->display, p->screen), InputOutput,
+                              XDefaultVisual(p->display, p->screen),
+                              (p->background ? CWBackPixmap : CWBackPixel) | CWOverrideRedirect | CWSaveUnder,
+                              &attrs);
+    // Every screen's pool adds to the same gauge
+    STAT_ADD(p->stats, pool_size, 1);
+    return w->window;
+}
+
+void pool_init(struct window_pool *p, Display *display, struct stats *stats, int screen, int min,
+               int x, int y, unsigned int width, unsigned int height, unsigned long pixel, Pixmap background) {
+    p->display = display;
+    p->stats = stats;
+    p->screen = screen;
+    p->size = 0;
+    p->in_use = 0;
+    p->min = min;
+    p->background = background;
+    p->opacity_atom = None;
+    p->idle_since = monotonic_ns();
+    while (p->size < min) create(p, x, y, width, height, pixel);
+}
+
+Window pool_acquire(struct window_pool *p, int x, int y, unsigned int width, unsigned int height,
+                    unsigned long pixel, unsigned long opacity) {
+    // Prefer a free window that already looks right, then any free window
+    struct pool_window *found = NULL;
+    for (int i = 0; i < p->size; i++) {
+        struct pool_window *w = &p->windows[i];
+        if (w->in_use) continue;
+        found = w;
+        if (w->x == x && w->y == y && w->width == width && w->height == height && w->pixel == pixel &&
+            w->opacity == opacity) break;
+    }
+
+    if (found == NULL) {
+        if (p->size == POOL_MAX_WINDOWS) return None;
+        STAT_ADD(p->stats, pool_misses, 1);
+        create(p, x, y, width, height, pixel);
+        found = &p->windows[p->size - 1];
+    } else {
+        STAT_ADD(p->stats, pool_hits, 1);
+        if (found->x != x || found->y != y || found->width != width || found->height != height) {
+            XMoveResizeWindow(p->display, found->window, x, y, width, height);
+            found->x = x;
+            found->y = y;
+            found->width = width;
+            found->height = height;
+        }
+        if (found->pixel != pixel && !p->background) {
+            XSetWindowBackground(p->display, found->window, pixel);
+            found->pixel = pixel;
+        }
+    }
+
+    if (found->opacity != opacity) {
+        XChangeProperty(p->display, found->window, p->opacity_atom, XA_CARDINAL, 32, PropModeReplace,
+                        (unsigned char *) &opacity, 1);
+        found->opacity = opacity;
+    }
+
+    found->in_use = true;
+    p->in_use++;
+    return found->window;
+}
+
+void pool_restyle(struct window_pool *p, Window window, unsigned long pixel, unsigned long opacity) {
+    for (int i = 0; i < p->size; i++) {
+        struct pool_window *w = &p->windows[i];
+        if (w->window != window || !w->in_use) continue;
+        if (w->pixel != pixel && !p->background) {
+            XSetWindowBackground(p->display, w->window, pixel);
+            // A mapped window is only repainted in its new background when cleared
+            XClearWindow(p->display, w->window);
+            w->pixel = pixel;
+        }
+        if (opacity > w->opacity) {
+            XChangeProperty(p->display, w->window, p->opacity_atom, XA_CARDINAL, 32, PropModeReplace,
+                            (unsigned char *) &opacity, 1);
+            w->opacity = opacity;
+        }
+        return;
+    }
+}
+
+void pool_release(struct window_pool *p, Window window) {
+    for (int i = 0; i < p->size; i++) {
+        if (p->windows[i].window == window && p->windows[i].in_use) {
+            p->windows[i].in_use = false;
+            if (--p->in_use == 0) p->idle_since = monotonic_ns();
+            return;
+        }
+    }
+}
+
+bool pool_trim_deadline(const struct window_pool *p, uint64_t *deadline) {
+    if (p->in_use || p->size <= p->min) return false;
+    *deadline = p->idle_since + POOL_IDLE_NS;
+    return true;
+}
+
+void pool_trim(struct window_pool *p, uint64_t now) {
+    uint64_t deadline;
+    if (!pool_trim_deadline(p, &deadline) || now < deadline) return;
+
+    // Nothing is in use so the spare windows are simply the ones past min
+    while (p->size > p->min) {
+        XDestroyWindow(p->display, p->windows[--p->size].window);
+        STAT_ADD(p->stats, pool_size, -1);
+    }
+}
+
+void pool_forget(struct window_pool *p, Window window) {
+    for (int i = 0; i < p->size; i++) {
+        if (p->windows[i].window != window) continue;
+        if (p->windows[i].in_use && --p->in_use == 0) p->idle_since = monotonic_ns();
+        p->windows[i] = p->windows[--p->size];
+        STAT_ADD(p->stats, pool_size, -1);
+        return;
+    }
+}
+
+void pool_free(struct window_pool *p) {
+    STAT_ADD(p->stats, pool_size, -p->size);
+    while (p->size) XDestroyWindow(p->display, p->windows[--p->size].window);
+    p->in_use = 0;
+}
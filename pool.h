@@ -0,0 +1,90 @@
+/*
+   xvisbell: visual bell for X11
+
+   Pool of pre-created flash windows
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_POOL_H
+#define XVISBELL_POOL_H
+
+#include "xvisbell.h"
+
+#include <X11/Xlib.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define POOL_MAX_WINDOWS 64 // Upper bound for --pool-size
+#define POOL_IDLE_NS (60 * 1000000000ULL) // Spare windows are destroyed after being unused this long
+#define POOL_OPAQUE 0xffffffffUL // _NET_WM_WINDOW_OPACITY of a window without the property
+
+// An override-redirect window and the geometry and background it was last given
+struct pool_window {
+    Window window;
+    bool in_use;
+    int x, y;
+    unsigned int width, height;
+    unsigned long pixel;
+    unsigned long opacity;
+};
+
+struct window_pool {
+    Display *display;
+    struct stats *stats; // Where hits, misses and windows are counted
+    int screen;
+
+    struct pool_window windows[POOL_MAX_WINDOWS];
+    int size; // Windows currently alive, free or in use
+    int in_use;
+    int min; // Windows kept even when idle, the expected number of concurrent flashes
+    Pixmap background; // Background of every window instead of its pixel, None for a solid colour
+    Atom opacity_atom; // _NET_WM_WINDOW_OPACITY, or None if every window is opaque
+    uint64_t idle_since; // When every window last became free
+};
+
+/*
+ * Create the first min windows with the given geometry and background, counting them in stats
+ * If background isn't None every window uses it as a background pixmap instead of the pixel
+ * Set opacity_atom afterwards to give windows an opacity in pool_acquire.
+ */
+void pool_init(struct window_pool *p, Display *display, struct stats *stats, int screen, int min,
+               int x, int y, unsigned int width, unsigned int height, unsigned long pixel, Pixmap background);
+
+/*
+ * Get an unmapped window with the given geometry, background and opacity (POOL_OPAQUE unless opacity_atom is set)
+ * A reused window only gets the requests needed to change what differs; a new one is created if none are free.
+ * Returns None if all POOL_MAX_WINDOWS windows are in use.
+ */
+Window pool_acquire(struct window_pool *p, int x, int y, unsigned int width, unsigned int height,
+                    unsigned long pixel, unsigned long opacity);
+
+/*
+ * Give a window from pool_acquire a new background and opacity while it is mapped, e.g. for a louder bell extending
+ * its flash. The opacity is only ever raised. Nothing is sent for what is unchanged.
+ */
+void pool_restyle(struct window_pool *p, Window window, unsigned long pixel, unsigned long opacity);
+
+// Give back a window from pool_acquire. It is unmapped by the caller.
+void pool_release(struct window_pool *p, Window window);
+
+/*
+ * Get when spare windows should be destroyed
+ * Returns false if there is nothing to shrink
+ */
+bool pool_trim_deadline(const struct window_pool *p, uint64_t *deadline);
+
+// Destroy spare windows if the pool has been idle for POOL_IDLE_NS
+void pool_trim(struct window_pool *p, uint64_t now);
+
+// Destroy every window
+void pool_free(struct window_pool *p);
+
+// Drop a window that no longer exists (e.g. destroyed by another client), whether or not it is in use
+void pool_forget(struct window_pool *p, Window window);
+
+#endif
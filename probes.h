@@ -0,0 +1,27 @@
+/*
+   xvisbell: visual bell for X11
+
+   USDT (sys/sdt.h) probes, compiled in with make USDT=1
+
+   Each probe is a single nop until a tracer attaches, e.g.
+   bpftrace -e 'usdt:./xvisbell:xvisbell:bell { printf("%d%%\n", arg0); }'
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_PROBES_H
+#define XVISBELL_PROBES_H
+
+#ifdef HAVE_USDT
+#include <sys/sdt.h>
+#define PROBE1(name, a) DTRACE_PROBE1(xvisbell, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(xvisbell, name, a, b)
+#else
+#define PROBE1(name, a) do {} while (0)
+#define PROBE2(name, a, b) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,59 @@
+/*
+   xvisbell: visual bell for X11
+
+   Lock-free single producer, single consumer message queue between two threads
+
+   Each index has one writer, so pushing and popping are a load, a copy and
+   a release store, with no locks that a low priority thread could hold
+   while the event thread waits. The wake pipe only exists so the consumer
+   can sleep in select() alongside its other descriptors.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "queue.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+bool queue_init(struct queue *q) {
+    q->head = q->tail = 0;
+    if (pipe(q->wake) < 0) return true;
+    for (int i = 0; i < 2; i++) {
+        fcntl(q->wake[i], F_SETFD, FD_CLOEXEC);
+        // A full pipe already wakes the consumer, and it drains the pipe without blocking
+        fcntl(q->wake[i], F_SETFL, O_NONBLOCK);
+    }
+    return false;
+}
+
+bool queue_push(struct queue *q, const struct message *m) {
+    unsigned int head = q->head;
+    if (head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == QUEUE_SIZE) return true;
+
+    q->messages[head % QUEUE_SIZE] = *m;
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+
+    char byte = 0;
+    ssize_t written = write(q->wake[1], &byte, 1);
+    (void) written; // Failing with EAGAIN means a wakeup is already pending
+    return false;
+}
+
+bool queue_pop(struct queue *q, struct message *m) {
+    unsigned int tail = q->tail;
+    if (tail == __atomic_load_n(&q->head, __ATOMIC_ACQUIRE)) {
+        // Empty, so clear the wakeups for the messages already taken. A push after this writes a new one.
+        char bytes[64];
+        while (read(q->wake[0], bytes, sizeof(bytes)) > 0);
+        // Check again in case a message arrived before the pipe was drained
+        if (tail == __atomic_load_n(&q->head, __ATOMIC_ACQUIRE)) return false;
+    }
+
+    *m = q->messages[tail % QUEUE_SIZE];
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
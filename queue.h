@@ -0,0 +1,63 @@
+/*
+   xvisbell: visual bell for X11
+
+   Lock-free single producer, single consumer message queue between two threads
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_QUEUE_H
+#define XVISBELL_QUEUE_H
+
+#include <X11/XKBlib.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define QUEUE_SIZE 64 // Must be a power of 2
+
+enum message_type {
+    MESSAGE_BELL, // Event thread to main thread: a bell rang, run its actions and record it
+    MESSAGE_RECORD, // Event thread to main thread: a bell rang but was rate limited, only record it
+    MESSAGE_FLASH, // Main thread to event thread: flash as if the bell rang (the control socket's flash command)
+    MESSAGE_EXIT, // Event thread to main thread: the event loop finished, e.g. at the end of a replay
+};
+
+struct message {
+    enum message_type type;
+    uint64_t ns; // When the bell was received or the command arrived
+    XkbBellNotifyEvent bell; // For MESSAGE_BELL and MESSAGE_RECORD
+};
+
+struct queue {
+    struct message messages[QUEUE_SIZE];
+    // On separate cache lines so the two threads don't keep taking the line from each other
+    unsigned int head __attribute__((aligned(64))); // Next slot to write, only written by the producer
+    unsigned int tail __attribute__((aligned(64))); // Next slot to read, only written by the consumer
+    int wake[2]; // Pipe the producer writes to after each message so the consumer can wait for it in select()
+};
+
+// Create the queue's wake pipe. Returns true on error.
+bool queue_init(struct queue *q);
+
+// Descriptor to select() on for reading, then call queue_pop until it returns false
+static inline int queue_fd(const struct queue *q) {
+    return q->wake[0];
+}
+
+/*
+ * Add a message and wake the consumer. Only call from the producer thread.
+ * Returns true if the queue was full
+ */
+bool queue_push(struct queue *q, const struct message *m);
+
+/*
+ * Take the oldest message. Only call from the consumer thread.
+ * Returns false if the queue is empty
+ */
+bool queue_pop(struct queue *q, struct message *m);
+
+#endif
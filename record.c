@@ -0,0 +1,117 @@
+/*
+   xvisbell: visual bell for X11
+
+   Recording bell events to a binary trace and replaying them
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "record.h"
+#include "xvisbell.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool record_open(struct recorder *r, const char *path) {
+    r->f = fopen(path, "wb");
+    if (r->f == NULL) return true;
+
+    struct record_header header = {.version = RECORD_VERSION, .record_size = sizeof(struct record)};
+    memcpy(header.magic, RECORD_MAGIC, sizeof(header.magic));
+    if (fwrite(&header, sizeof(header), 1, r->f) != 1) {
+        fclose(r->f);
+        r->f = NULL;
+        return true;
+    }
+    return false;
+}
+
+void record_event(struct recorder *r, const XkbBellNotifyEvent *ev, uint64_t recv_ns) {
+    struct record rec = {
+        .recv_ns = recv_ns,
+        .time = ev->time,
+        .window = ev->window,
+        .name = ev->name,
+        .bell_class = ev->bell_class,
+        .bell_id = ev->bell_id,
+        .percent = ev->percent,
+        .pitch = ev->pitch,
+        .duration = ev->duration,
+    };
+    fwrite(&rec, sizeof(rec), 1, r->f);
+}
+
+void record_flush(struct recorder *r) {
+    fflush(r->f);
+}
+
+bool replay_open(struct replay *r, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return true;
+
+    struct record_header header;
+    if (fread(&header, sizeof(header), 1, f) != 1
+        || memcmp(header.magic, RECORD_MAGIC, sizeof(header.magic)) != 0
+        || header.version != RECORD_VERSION
+        || header.record_size != sizeof(struct record)) {
+        fclose(f);
+        return true;
+    }
+
+    // Read the rest of the file in one go, growing the buffer as needed
+    size_t capacity = 1024;
+    r->records = malloc(capacity * sizeof(struct record));
+    r->n_records = 0;
+    while (r->records) {
+        r->n_records += fread(r->records + r->n_records, sizeof(struct record), capacity - r->n_records, f);
+        if (r->n_records < capacity) break;
+        capacity *= 2;
+        struct record *grown = realloc(r->records, capacity * sizeof(struct record));
+        if (grown == NULL) free(r->records);
+        r->records = grown;
+    }
+
+    bool error = ferror(f) || r->records == NULL;
+    fclose(f);
+    r->next = 0;
+    return error;
+}
+
+void replay_start(struct replay *r) {
+    r->start_ns = monotonic_ns();
+}
+
+bool replay_next_deadline(struct replay *r, uint64_t *deadline) {
+    if (r->next >= r->n_records) return false;
+    if (r->speed == 0) {
+        *deadline = r->start_ns;
+        return true;
+    }
+
+    uint64_t offset = r->records[r->next].recv_ns - r->records[0].recv_ns;
+    *deadline = r->start_ns + (uint64_t) (offset / r->speed);
+    return true;
+}
+
+bool replay_next_event(struct replay *r, uint64_t now, int xkb_event_base, XkbBellNotifyEvent *ev) {
+    uint64_t deadline;
+    if (!replay_next_deadline(r, &deadline) || deadline > now) return false;
+
+    const struct record *rec = &r->records[r->next++];
+    memset(ev, 0, sizeof(*ev));
+    ev->type = xkb_event_base;
+    ev->xkb_type = XkbBellNotify;
+    ev->time = rec->time;
+    ev->device = XkbUseCoreKbd;
+    ev->percent = rec->percent;
+    ev->pitch = rec->pitch;
+    ev->duration = rec->duration;
+    ev->bell_class = rec->bell_class;
+    ev->bell_id = rec->bell_id;
+    ev->name = rec->name;
+    ev->window = rec->window;
+    return true;
+}
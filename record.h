@@ -0,0 +1,93 @@
+/*
+   xvisbell: visual bell for X11
+
+   Recording bell events to a binary trace and replaying them
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_RECORD_H
+#define XVISBELL_RECORD_H
+
+#include <X11/XKBlib.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * A trace file is a header followed by fixed size records, both in host byte order.
+ * Traces are meant to be replayed on the machine (or at least the architecture)
+ * they were recorded on.
+ */
+#define RECORD_MAGIC "XVBTRACE"
+#define RECORD_VERSION 1
+
+struct record_header {
+    char magic[8]; // RECORD_MAGIC without the terminating NUL
+    uint32_t version; // RECORD_VERSION
+    uint32_t record_size; // sizeof(struct record)
+};
+
+struct record {
+    uint64_t recv_ns; // CLOCK_MONOTONIC when xvisbell read the event
+    uint32_t time; // Server timestamp in ms
+    uint32_t window; // Window the bell was rung for, 0 for None
+    uint32_t name; // Atom naming the bell, 0 for None
+    int16_t bell_class;
+    int16_t bell_id;
+    int16_t percent;
+    int16_t pitch;
+    int16_t duration;
+    int16_t padding;
+};
+
+struct recorder {
+    FILE *f; // NULL when not recording
+};
+
+/*
+ * Start recording to path, truncating it
+ * Returns true on error
+ */
+bool record_open(struct recorder *r, const char *path);
+
+// Append one event. Records are buffered until record_flush
+void record_event(struct recorder *r, const XkbBellNotifyEvent *ev, uint64_t recv_ns);
+
+void record_flush(struct recorder *r);
+
+struct replay {
+    struct record *records; // NULL when not replaying
+    size_t n_records;
+    size_t next; // Index of the next record to dispatch
+    double speed; // 1 for real time, 2 for twice as fast, 0 for no delays at all
+    uint64_t start_ns; // CLOCK_MONOTONIC when replay started
+};
+
+/*
+ * Load a whole trace into memory
+ * Returns true on error
+ */
+bool replay_open(struct replay *r, const char *path);
+
+// Start the replay clock
+void replay_start(struct replay *r);
+
+/*
+ * Get the time (CLOCK_MONOTONIC ns) the next record is due
+ * Returns false if every record has been dispatched
+ */
+bool replay_next_deadline(struct replay *r, uint64_t *deadline);
+
+/*
+ * Fill ev from the next record if it is due by now and advance
+ * Returns false if no record is due
+ */
+bool replay_next_event(struct replay *r, uint64_t now, int xkb_event_base, XkbBellNotifyEvent *ev);
+
+#endif
@@ -0,0 +1,102 @@
+/*
+   xvisbell: visual bell for X11
+
+   Scheduler for concurrent flashes with independent deadlines
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "sched.h"
+#include "xvisbell.h"
+
+static void swap(struct scheduler *s, int i, int j) {
+    struct sched_flash tmp = s->heap[i];
+    s->heap[i] = s->heap[j];
+    s->heap[j] = tmp;
+}
+
+static void sift_up(struct scheduler *s, int i) {
+    while (i > 0 && s->heap[(i - 1) / 2].end_ns > s->heap[i].end_ns) {
+        swap(s, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void sift_down(struct scheduler *s, int i) {
+    for (;;) {
+        int smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+        if (left < s->n && s->heap[left].end_ns < s->heap[smallest].end_ns) smallest = left;
+        if (right < s->n && s->heap[right].end_ns < s->heap[smallest].end_ns) smallest = right;
+        if (smallest == i) return;
+        swap(s, i, smallest);
+        i = smallest;
+    }
+}
+
+void sched_remove(struct scheduler *s, int i) {
+    s->n--;
+    if (i == s->n) return;
+    s->heap[i] = s->heap[s->n];
+    sift_up(s, i);
+    sift_down(s, i);
+}
+
+int sched_find(const struct scheduler *s, unsigned long key) {
+    // There are only a handful of flashes so a linear search beats keeping an index
+    for (int i = 0; i < s->n; i++) {
+        if (s->heap[i].key == key) return i;
+    }
+    return -1;
+}
+
+void sched_extend(struct scheduler *s, int i, int priority, uint64_t end_ns) {
+    if (priority > s->heap[i].priority) s->heap[i].priority = priority;
+    // A shorter flash rung on top of a longer one mustn't cut it short
+    if (end_ns <= s->heap[i].end_ns) return;
+    s->heap[i].end_ns = end_ns;
+    sift_down(s, i);
+}
+
+// Hide flash i and take it out of the heap
+static void hide_at(struct scheduler *s, int i, bool expired) {
+    s->hide(&s->heap[i], expired, s->hide_data);
+    sched_remove(s, i);
+}
+
+void sched_hide(struct scheduler *s, int i) {
+    hide_at(s, i, false);
+}
+
+bool sched_make_room(struct scheduler *s, int priority) {
+    if (s->n < s->max) return true;
+
+    int lowest = 0;
+    for (int i = 1; i < s->n; i++) {
+        if (s->heap[i].priority < s->heap[lowest].priority) lowest = i;
+    }
+    if (s->heap[lowest].priority > priority) {
+        STAT_ADD(s->stats, flashes_refused, 1);
+        return false;
+    }
+    hide_at(s, lowest, false);
+    STAT_ADD(s->stats, flashes_evicted, 1);
+    return true;
+}
+
+void sched_add(struct scheduler *s, unsigned long key, Window window, int priority, uint64_t end_ns) {
+    s->heap[s->n] = (struct sched_flash){key, window, priority, end_ns};
+    s->n++;
+    sift_up(s, s->n - 1);
+}
+
+int sched_expire(struct scheduler *s, uint64_t now) {
+    int hidden = 0;
+    while (s->n && s->heap[0].end_ns <= now) {
+        hide_at(s, 0, true);
+        hidden++;
+    }
+    return hidden;
+}
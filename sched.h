@@ -0,0 +1,86 @@
+/*
+   xvisbell: visual bell for X11
+
+   Scheduler for concurrent flashes with independent deadlines
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_SCHED_H
+#define XVISBELL_SCHED_H
+
+#include "xvisbell.h"
+
+#include <X11/Xlib.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SCHED_MAX_FLASHES 64 // Upper bound for --max-flashes
+
+struct sched_flash {
+    unsigned long key; // What is being flashed, e.g. the window a targeted flash covers
+    Window window; // The window showing the flash
+    int priority; // Higher priority flashes evict lower priority ones when the scheduler is full
+    uint64_t end_ns; // CLOCK_MONOTONIC deadline
+};
+
+/*
+ * Called to take each flash off the screen (e.g. unmap its window)
+ * expired is false if the flash was evicted to make room for another
+ */
+typedef void (*sched_hide_fn)(struct sched_flash *flash, bool expired, void *data);
+
+/*
+ * Visible flashes, kept in a binary min-heap ordered by deadline so the next
+ * wakeup is the root and expiring any number of due flashes takes one wakeup.
+ * The scheduler only keeps time; putting flashes on screen is up to the caller.
+ */
+struct scheduler {
+    struct sched_flash heap[SCHED_MAX_FLASHES];
+    int n; // Number of visible flashes
+    int max; // Maximum number of concurrent flashes
+    sched_hide_fn hide;
+    void *hide_data;
+    struct stats *stats; // Where evictions and refusals are counted
+};
+
+// Returns the heap index of the visible flash for key, or -1 if there is none
+int sched_find(const struct scheduler *s, unsigned long key);
+
+// Take flash i (from sched_find) out without hiding it, e.g. because its window is gone
+void sched_remove(struct scheduler *s, int i);
+
+// Hide flash i (from sched_find) early
+void sched_hide(struct scheduler *s, int i);
+
+// Move the deadline of visible flash i (from sched_find) to end_ns, if that is later
+void sched_extend(struct scheduler *s, int i, int priority, uint64_t end_ns);
+
+/*
+ * Make sure another flash of the given priority fits
+ * If max flashes are visible the lowest priority one is hidden, unless they all have a higher priority.
+ * Returns false if there is no room.
+ */
+bool sched_make_room(struct scheduler *s, int priority);
+
+// Add a flash that has just been shown, until end_ns. There must be room (see sched_make_room).
+void sched_add(struct scheduler *s, unsigned long key, Window window, int priority, uint64_t end_ns);
+
+/*
+ * Get the earliest deadline of the visible flashes
+ * Returns false if no flashes are visible
+ */
+static inline bool sched_next_deadline(const struct scheduler *s, uint64_t *deadline) {
+    if (s->n == 0) return false;
+    *deadline = s->heap[0].end_ns;
+    return true;
+}
+
+// Hide every flash whose deadline is at or before now. Returns how many were hidden.
+int sched_expire(struct scheduler *s, uint64_t now);
+
+#endif
@@ -0,0 +1,289 @@
+/*
+   xvisbell: visual bell for X11
+
+   Self-check: how long flashes really stay on screen compared to the configured duration
+
+   A second connection watches the root windows for the flash windows being
+   mapped and unmapped. Under Xvfb, which draws as it processes requests,
+   the time between the two notifications is how long the flash was
+   visible, so the error against the configured duration is everything
+   that delays the unmap (timer slack, scheduling, the X server) less what
+   delays the map.
+
+   Built with HAVE_XDAMAGE the observer can also ring the bell itself and
+   watch for the flash's pixels changing, to break the latency from the
+   bell to the flash being drawn down into its stages.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+// For ppoll()
+#define _GNU_SOURCE
+
+#include "selfcheck.h"
+#include "xvisbell.h"
+
+#ifdef HAVE_XDAMAGE
+#include <X11/extensions/Xdamage.h>
+#endif
+
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdlib.h>
+
+#define SELFCHECK_TIMEOUT_NS 1000000000ULL // How long past its deadline a flash may take to be seen
+
+static int compare(const void *a, const void *b) {
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+// Print the percentiles of count sorted values in ns, as us
+static void print_percentiles(FILE *out, const char *name, const int64_t *values, unsigned long count) {
+    fprintf(out, "%s (us): min %.1f, p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n", name,
+            values[0] / 1e3, values[count / 2] / 1e3, values[count * 90 / 100] / 1e3,
+            values[count * 99 / 100] / 1e3, values[count * 999 / 1000] / 1e3, values[count - 1] / 1e3);
+}
+
+/*
+ * Wait for the observer's connection or the flashes' next deadline, UINT64_MAX for none. Returns true on error.
+ * The timeout is to the ns like the daemon's pselect(), so the flashes are hidden as late or early as they would be there.
+ */
+static bool wait_for(struct xvisbell *v, Display *observer, uint64_t timeout_ns, FILE *out) {
+    uint64_t deadline = xvisbell_next_deadline(v);
+    if (deadline > timeout_ns) deadline = timeout_ns;
+    struct timespec timeout, *timeout_ptr = NULL;
+    if (deadline != UINT64_MAX) {
+        uint64_t now = monotonic_ns();
+        uint64_t wait = deadline > now ? deadline - now : 0;
+        timeout = (struct timespec){wait / 1000000000, wait % 1000000000};
+        timeout_ptr = &timeout;
+    }
+    struct pollfd fds[2] = {
+        {.fd = xvisbell_fd(v), .events = POLLIN},
+        {.fd = ConnectionNumber(observer), .events = POLLIN},
+    };
+    if (ppoll(fds, 2, timeout_ptr, NULL) < 0 && errno != EINTR) {
+        fprintf(out, "Error in ppoll() (errno %d)\n", errno);
+        return true;
+    }
+    return false;
+}
+
+// Whether window is one of the pooled flash windows
+static bool is_flash(const struct xvisbell *v, Window window) {
+    for (int i = 0; i < ScreenCount(v->display); i++) {
+        const struct window_pool *p = &v->screens[i].pool;
+        for (int j = 0; j < p->size; j++) {
+            if (p->windows[j].window == window) return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Flash once and wait until the observer has seen the flash hidden
+ * Returns how long it was visible in ns, or -1 on error
+ */
+static int64_t measure(struct xvisbell *v, Display *observer, FILE *out) {
+    XkbBellNotifyEvent ev = {.xkb_type = XkbBellNotify, .device = XkbUseCoreKbd, .percent = 100};
+    uint64_t rung = monotonic_ns();
+    if (xvisbell_bell(v, &ev, rung)) {
+        fprintf(out, "%s\n", xvisbell_error(v));
+        return -1;
+    }
+    xvisbell_flush(v);
+
+    uint64_t mapped = 0, timeout_ns = rung + v->config.duration_ns + SELFCHECK_TIMEOUT_NS;
+    for (;;) {
+        uint64_t now = monotonic_ns();
+        if (now >= timeout_ns) {
+            fprintf(out, "Timed out waiting for the flash to be %s\n", mapped ? "unmapped" : "mapped");
+            return -1;
+        }
+        if (wait_for(v, observer, timeout_ns, out)) return -1;
+
+        // Notifications are timed as soon as they are read, before flashing does any work
+        while (XPending(observer)) {
+            XEvent note;
+            XNextEvent(observer, &note);
+            now = monotonic_ns();
+            if (note.type == MapNotify && is_flash(v, note.xmap.window)) mapped = now;
+            else if (note.type == UnmapNotify && mapped && is_flash(v, note.xunmap.window)) return now - mapped;
+        }
+        if (xvisbell_dispatch(v)) {
+            fprintf(out, "%s\n", xvisbell_error(v));
+            return -1;
+        }
+    }
+}
+
+bool selfcheck_run(struct xvisbell *v, unsigned long count, FILE *out) {
+    int64_t *errors = malloc(count * sizeof(int64_t));
+    if (errors == NULL) {
+        fprintf(out, "Error allocating %lu samples\n", count);
+        return true;
+    }
+    Display *observer = XOpenDisplay(DisplayString(v->display));
+    if (observer == NULL) {
+        fprintf(out, "Error opening a second connection to the display\n");
+        free(errors);
+        return true;
+    }
+    // The observer's own event mask, so nothing selected by the flashing connection is touched
+    for (int i = 0; i < ScreenCount(observer); i++) {
+        XSelectInput(observer, XRootWindow(observer, i), SubstructureNotifyMask);
+    }
+    XSync(observer, False);
+
+    double sum = 0;
+    for (unsigned long i = 0; i < count; i++) {
+        int64_t visible = measure(v, observer, out);
+        if (visible < 0) {
+            free(errors);
+            XCloseDisplay(observer);
+            return true;
+        }
+        errors[i] = visible - (int64_t) v->config.duration_ns;
+        sum += errors[i];
+    }
+    XCloseDisplay(observer);
+
+    qsort(errors, count, sizeof(int64_t), compare);
+    fprintf(out, "%lu flashes of %" PRIu64 ".%03" PRIu64 " ms\n", count,
+            v->config.duration_ns / 1000000, v->config.duration_ns / 1000 % 1000);
+    // Only the flash path is exercised, not the rest of what the daemon's loop does between bells
+    fprintf(out, "timed: bell, flash and unmap through xvisbell_dispatch, waiting in ppoll() to the ns;"
+            " not included: the control socket, signals, metrics, --rt-priority's event thread\n");
+    fprintf(out, "visible - requested mean %.1f us\n", sum / count / 1e3);
+    print_percentiles(out, "visible - requested", errors, count);
+    // Jitter is the spread, which the fixed part of the error (e.g. the server's latency) doesn't affect
+    fprintf(out, "jitter (us): p99 - p50 %.1f, max - min %.1f\n",
+            (errors[count * 99 / 100] - errors[count / 2]) / 1e3, (errors[count - 1] - errors[0]) / 1e3);
+    free(errors);
+    return false;
+}
+
+#ifdef HAVE_XDAMAGE
+// When the stages of one bell happened
+struct bell_times {
+    uint64_t rung; // The observer sent the bell request
+    uint64_t received; // The bell event was read
+    uint64_t flushed; // The flash's requests were sent
+    uint64_t drawn; // The observer was told the pixels changed
+};
+
+static void on_bell(XkbBellNotifyEvent *ev, uint64_t recv_ns, bool limited, void *data) {
+    (void) ev;
+    (void) limited;
+    struct bell_times *times = data;
+    if (times->received == 0) times->received = recv_ns;
+}
+
+/*
+ * Ring the bell from the observer and time it until the observer is told the flash was drawn
+ * Returns true on error
+ */
+static bool time_bell(struct xvisbell *v, Display *observer, int damage_event, struct bell_times *times, FILE *out) {
+    *times = (struct bell_times){.rung = monotonic_ns()};
+    XBell(observer, 100);
+    XFlush(observer);
+
+    uint64_t timeout_ns = times->rung + SELFCHECK_TIMEOUT_NS;
+    while (times->drawn == 0) {
+        if (monotonic_ns() >= timeout_ns) {
+            fprintf(out, "Timed out waiting for the flash to be %s\n", times->received ? "drawn" : "rung");
+            return true;
+        }
+        if (wait_for(v, observer, timeout_ns, out)) return true;
+
+        while (XPending(observer)) {
+            XEvent ev;
+            XNextEvent(observer, &ev);
+            uint64_t now = monotonic_ns();
+            // Damage from before the flash went out (e.g. the last flash being hidden) isn't this flash
+            if (ev.type == damage_event + XDamageNotify && times->flushed && times->drawn == 0) times->drawn = now;
+        }
+        if (xvisbell_dispatch(v)) {
+            fprintf(out, "%s\n", xvisbell_error(v));
+            return true;
+        }
+        // Dispatching sends the flash's requests before returning
+        if (times->received && times->flushed == 0) times->flushed = monotonic_ns();
+    }
+
+    // Let the flash end and its damage arrive so it isn't mistaken for the next one's
+    while (xvisbell_visible(v)) {
+        if (wait_for(v, observer, UINT64_MAX, out)) return true;
+        if (xvisbell_dispatch(v)) {
+            fprintf(out, "%s\n", xvisbell_error(v));
+            return true;
+        }
+    }
+    XSync(v->display, False);
+    XSync(observer, False);
+    while (XPending(observer)) {
+        XEvent ev;
+        XNextEvent(observer, &ev);
+    }
+    return false;
+}
+
+bool selfcheck_latency(struct xvisbell *v, unsigned long count, FILE *out) {
+    int64_t *stages = malloc(count * 4 * sizeof(int64_t));
+    if (stages == NULL) {
+        fprintf(out, "Error allocating %lu samples\n", count);
+        return true;
+    }
+    Display *observer = XOpenDisplay(DisplayString(v->display));
+    if (observer == NULL) {
+        fprintf(out, "Error opening a second connection to the display\n");
+        free(stages);
+        return true;
+    }
+    int damage_event, damage_error;
+    if (!XDamageQueryExtension(observer, &damage_event, &damage_error)) {
+        fprintf(out, "X server doesn't support the Damage extension\n");
+        XCloseDisplay(observer);
+        free(stages);
+        return true;
+    }
+    // Damage on a root window includes its children, so this sees flash windows and the overlay alike
+    for (int i = 0; i < ScreenCount(observer); i++) {
+        XDamageCreate(observer, XRootWindow(observer, i), XDamageReportRawRectangles);
+    }
+    XSync(observer, False);
+
+    struct bell_times times;
+    v->config.on_bell = on_bell;
+    v->config.on_bell_data = &times;
+    int64_t *ring = stages, *client = stages + count, *request = stages + 2 * count, *total = stages + 3 * count;
+    for (unsigned long i = 0; i < count; i++) {
+        if (time_bell(v, observer, damage_event, &times, out)) {
+            XCloseDisplay(observer);
+            free(stages);
+            return true;
+        }
+        ring[i] = times.received - times.rung;
+        client[i] = times.flushed - times.received;
+        request[i] = times.drawn - times.flushed;
+        total[i] = times.drawn - times.rung;
+    }
+    // Closing the connection destroys its Damage objects
+    XCloseDisplay(observer);
+
+    fprintf(out, "%lu bells of %" PRIu64 ".%03" PRIu64 " ms\n", count,
+            v->config.duration_ns / 1000000, v->config.duration_ns / 1000 % 1000);
+    const char *names[] = {"server -> client", "client -> request", "request -> damage", "total"};
+    for (int i = 0; i < 4; i++) {
+        qsort(stages + i * count, count, sizeof(int64_t), compare);
+        print_percentiles(out, names[i], stages + i * count, count);
+    }
+    free(stages);
+    return false;
+}
+#endif
@@ -0,0 +1,37 @@
+/*
+   xvisbell: visual bell for X11
+
+   Self-check: how long flashes really stay on screen compared to the configured duration
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_SELFCHECK_H
+#define XVISBELL_SELFCHECK_H
+
+#include "libxvisbell.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Flash count times, one after another, and time each flash from its MapNotify to its UnmapNotify
+ * as seen by a second connection to the server, then print percentiles of the error to out
+ * v must use the window renderer and be set up. Returns true on error, with the reason printed.
+ */
+bool selfcheck_run(struct xvisbell *v, unsigned long count, FILE *out);
+
+#ifdef HAVE_XDAMAGE
+/*
+ * Ring the bell count times from a second connection, waiting for each flash to end, and print percentiles of
+ * each stage of its latency: the bell reaching v, v sending the flash, and the second connection getting the
+ * DamageNotify for its pixels
+ * v must be listening for bells and set up. Its on_bell is replaced. Returns true on error, with the reason printed.
+ */
+bool selfcheck_latency(struct xvisbell *v, unsigned long count, FILE *out);
+#endif
+
+#endif
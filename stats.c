@@ -0,0 +1,226 @@
+/*
+   xvisbell: visual bell for X11
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "xvisbell.h"
+
+#include <inttypes.h>
+#include <limits.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+struct stats stats = STATS_INIT;
+
+void stats_wake(struct stats *s) {
+    char byte = 0;
+    ssize_t written = write(s->wake_fd, &byte, 1);
+    (void) written; // Failing with EAGAIN means a wakeup is already pending
+}
+
+static const uint64_t histogram_bounds[HISTOGRAM_BUCKETS - 1] = HISTOGRAM_BOUNDS;
+
+// Relaxed atomics as for STAT_GET and STAT_SET; histograms have a single writer too
+#define LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STORE(x, value) __atomic_store_n(&(x), (value), __ATOMIC_RELAXED)
+
+void histogram_observe(struct histogram *h, uint64_t ns) {
+    int i = 0;
+    while (i < HISTOGRAM_BUCKETS - 1 && ns > histogram_bounds[i] * 1000) i++;
+    STORE(h->buckets[i], h->buckets[i] + 1);
+    STORE(h->count, h->count + 1);
+    STORE(h->sum_ns, h->sum_ns + ns);
+    if (ns > h->max_ns) STORE(h->max_ns, ns);
+}
+
+static void print_histogram(FILE *f, const char *name, const struct histogram *h) {
+    uint64_t count = LOAD(h->count);
+    fprintf(f, "%s avg: %" PRIu64 " us\n", name, count ? LOAD(h->sum_ns) / count / 1000 : 0);
+    fprintf(f, "%s max: %" PRIu64 " us\n", name, LOAD(h->max_ns) / 1000);
+}
+
+// Names of the core X error codes, see X11/X.h
+static const char *x_error_names[STATS_X_ERROR_CODES] = {
+    "extension", "BadRequest", "BadValue", "BadWindow", "BadPixmap", "BadAtom", "BadCursor", "BadFont", "BadMatch",
+    "BadDrawable", "BadAccess", "BadAlloc", "BadColor", "BadGC", "BadIDChoice", "BadName", "BadLength",
+    "BadImplementation",
+};
+
+void stats_print(const struct stats *s, FILE *f) {
+    fprintf(f, "bells: %" PRIu64 "\n", STAT_GET(s, bells));
+    fprintf(f, "bells deferred: %" PRIu64 "\n", STAT_GET(s, bells_deferred));
+    fprintf(f, "flashes: %" PRIu64 "\n", STAT_GET(s, flashes));
+    fprintf(f, "extended: %" PRIu64 "\n", STAT_GET(s, extended));
+    fprintf(f, "flashes evicted: %" PRIu64 "\n", STAT_GET(s, flashes_evicted));
+    fprintf(f, "flashes refused: %" PRIu64 "\n", STAT_GET(s, flashes_refused));
+    fprintf(f, "window pool size: %" PRIu64 "\n", STAT_GET(s, pool_size));
+    uint64_t hits = STAT_GET(s, pool_hits), misses = STAT_GET(s, pool_misses);
+    fprintf(f, "window pool hit rate: %.1f%% (%" PRIu64 " hits, %" PRIu64 " misses)\n",
+            hits + misses ? 100.0 * hits / (hits + misses) : 0, hits, misses);
+    fprintf(f, "backpressure merged: %" PRIu64 "\n", STAT_GET(s, backpressure_merged));
+    fprintf(f, "backpressure dropped: %" PRIu64 "\n", STAT_GET(s, backpressure_dropped));
+    fprintf(f, "rate limited: %" PRIu64 "\n", STAT_GET(s, rate_limited));
+    for (int i = 0; i < STATS_TOP_CLIENTS && STAT_GET(s, top_clients[i].bells); i++) {
+        uint64_t id = STAT_GET(s, top_clients[i].id), pid = STAT_GET(s, top_clients[i].pid);
+        if (id) fprintf(f, "client 0x%" PRIx64, id);
+        else fprintf(f, "client unknown");
+        if (pid) fprintf(f, " (pid %" PRIu64 ")", pid);
+        fprintf(f, ": %" PRIu64 " bells, %" PRIu64 " rate limited\n",
+                STAT_GET(s, top_clients[i].bells), STAT_GET(s, top_clients[i].rate_limited));
+    }
+    for (int i = 0; i < STATS_X_ERROR_CODES; i++) {
+        uint64_t errors = STAT_GET(s, x_errors[i]);
+        if (errors) fprintf(f, "X errors (%s): %" PRIu64 "\n", x_error_names[i], errors);
+    }
+    fprintf(f, "flashes failed: %" PRIu64 "\n", STAT_GET(s, flashes_failed));
+    print_histogram(f, "bell to request latency", &s->latency);
+    print_histogram(f, "server lag", &s->server_lag);
+    fprintf(f, "X requests: %" PRIu64 "\n", STAT_GET(s, x_requests));
+    fprintf(f, "startup: %" PRIu64 " us\n", STAT_GET(s, startup_ns) / 1000);
+    fprintf(f, "first flash after: %" PRIu64 " us\n", STAT_GET(s, first_flash_ns) / 1000);
+    if (STAT_GET(s, texture_bytes)) {
+        uint64_t textures = STAT_GET(s, textures), shm = STAT_GET(s, textures_shm);
+        fprintf(f, "texture upload: %" PRIu64 " us for %" PRIu64 " screens (%" PRIu64 " through MIT-SHM)\n",
+                STAT_GET(s, texture_upload_ns) / 1000, textures, shm);
+        fprintf(f, "texture server memory: %" PRIu64 " bytes\n", STAT_GET(s, texture_bytes));
+        if (STAT_GET(s, texture_kernel)) {
+            fprintf(f, "texture generation: %" PRIu64 " us (%s)\n", STAT_GET(s, texture_generate_ns) / 1000,
+                    STAT_GET(s, texture_kernel));
+        }
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(f, "cpu user: %ld.%06ld s\n", (long) usage.ru_utime.tv_sec, (long) usage.ru_utime.tv_usec);
+    fprintf(f, "cpu system: %ld.%06ld s\n", (long) usage.ru_stime.tv_sec, (long) usage.ru_stime.tv_usec);
+
+    if (STAT_GET(s, sounds)) {
+        fprintf(f, "sounds: %" PRIu64 "\n", STAT_GET(s, sounds));
+        fprintf(f, "sounds stolen: %" PRIu64 "\n", STAT_GET(s, sounds_stolen));
+        fprintf(f, "sound underruns: %" PRIu64 "\n", STAT_GET(s, sound_xruns));
+    }
+
+    fprintf(f, "actions spawned: %" PRIu64 "\n", STAT_GET(s, actions_spawned));
+    fprintf(f, "actions failed: %" PRIu64 "\n", STAT_GET(s, actions_failed));
+    fprintf(f, "actions queued: %" PRIu64 "\n", STAT_GET(s, actions_queued));
+    fprintf(f, "actions coalesced: %" PRIu64 "\n", STAT_GET(s, actions_coalesced));
+    fprintf(f, "actions dropped: %" PRIu64 "\n", STAT_GET(s, actions_dropped));
+    print_histogram(f, "spawn latency", &s->spawn);
+    fflush(f);
+}
+
+#ifdef HAVE_METRICS
+static void metric(FILE *f, const char *name, const char *type, const char *help, uint64_t value) {
+    fprintf(f, "# HELP xvisbell_%s %s\n# TYPE xvisbell_%s %s\nxvisbell_%s %" PRIu64 "\n",
+            name, help, name, type, name, value);
+}
+
+static void metric_histogram(FILE *f, const char *name, const char *help, const struct histogram *h) {
+    fprintf(f, "# HELP xvisbell_%s %s\n# TYPE xvisbell_%s histogram\n", name, help, name);
+
+    uint64_t cumulative = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS - 1; i++) {
+        cumulative += LOAD(h->buckets[i]);
+        fprintf(f, "xvisbell_%s_bucket{le=\"%g\"} %" PRIu64 "\n", name, histogram_bounds[i] / 1e6, cumulative);
+    }
+    // Counted from the buckets so the total stays consistent with them while the writer is running
+    cumulative += LOAD(h->buckets[HISTOGRAM_BUCKETS - 1]);
+    fprintf(f, "xvisbell_%s_bucket{le=\"+Inf\"} %" PRIu64 "\n", name, cumulative);
+    fprintf(f, "xvisbell_%s_sum %.9f\n", name, LOAD(h->sum_ns) / 1e9);
+    fprintf(f, "xvisbell_%s_count %" PRIu64 "\n", name, cumulative);
+}
+
+// Resident set size in bytes, 0 if it can't be determined
+static uint64_t resident_bytes(void) {
+    unsigned long size, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == NULL) return 0;
+    if (fscanf(f, "%lu %lu", &size, &resident) != 2) resident = 0;
+    fclose(f);
+    return (uint64_t) resident * sysconf(_SC_PAGESIZE);
+}
+
+void stats_print_metrics(const struct stats *s, FILE *f) {
+    metric(f, "bells_total", "counter", "Bell events received.", STAT_GET(s, bells));
+    metric(f, "bells_deferred_total", "counter", "Bells that waited for their window to be located.",
+           STAT_GET(s, bells_deferred));
+    metric(f, "flashes_total", "counter", "Flashes shown.", STAT_GET(s, flashes));
+    metric(f, "bells_coalesced_total", "counter", "Bells merged into a flash that was already visible.",
+           STAT_GET(s, extended));
+    metric(f, "flashes_evicted_total", "counter", "Flashes hidden early to make room for another.",
+           STAT_GET(s, flashes_evicted));
+    metric(f, "flashes_refused_total", "counter", "Flashes not shown because the scheduler was full.",
+           STAT_GET(s, flashes_refused));
+    metric(f, "pool_hits_total", "counter", "Flashes shown in an existing pooled window.", STAT_GET(s, pool_hits));
+    metric(f, "pool_misses_total", "counter", "Flashes that had to create a window.", STAT_GET(s, pool_misses));
+    metric(f, "pool_windows", "gauge", "Flash windows alive.", STAT_GET(s, pool_size));
+    metric(f, "backpressure_merged_total", "counter",
+           "Bells merged into the visible flash because the X server was lagging.", STAT_GET(s, backpressure_merged));
+    metric(f, "backpressure_dropped_total", "counter", "Bells not flashed because the X server was lagging.",
+           STAT_GET(s, backpressure_dropped));
+    metric(f, "rate_limited_total", "counter", "Bells ignored because their client was over the rate limit.",
+           STAT_GET(s, rate_limited));
+    fprintf(f, "# HELP xvisbell_client_bells_total Bells rung by each of the noisiest clients.\n"
+            "# TYPE xvisbell_client_bells_total counter\n");
+    for (int i = 0; i < STATS_TOP_CLIENTS && STAT_GET(s, top_clients[i].bells); i++) {
+        fprintf(f, "xvisbell_client_bells_total{client=\"0x%" PRIx64 "\",pid=\"%" PRIu64 "\"} %" PRIu64 "\n",
+                STAT_GET(s, top_clients[i].id), STAT_GET(s, top_clients[i].pid), STAT_GET(s, top_clients[i].bells));
+    }
+    fprintf(f, "# HELP xvisbell_x_errors_total X protocol errors received.\n"
+            "# TYPE xvisbell_x_errors_total counter\n");
+    for (int i = 0; i < STATS_X_ERROR_CODES; i++) {
+        fprintf(f, "xvisbell_x_errors_total{code=\"%s\"} %" PRIu64 "\n", x_error_names[i], STAT_GET(s, x_errors[i]));
+    }
+    metric(f, "flashes_failed_total", "counter", "Flashes dropped because an X request for them failed.",
+           STAT_GET(s, flashes_failed));
+    metric(f, "x_requests_total", "counter", "X requests sent.", STAT_GET(s, x_requests));
+    metric(f, "actions_spawned_total", "counter", "Commands started.", STAT_GET(s, actions_spawned));
+    metric(f, "actions_failed_total", "counter", "Commands that failed to start.", STAT_GET(s, actions_failed));
+    metric(f, "actions_queued_total", "counter", "Commands that waited for a free slot.", STAT_GET(s, actions_queued));
+    metric(f, "actions_coalesced_total", "counter", "Commands merged into an already queued run.",
+           STAT_GET(s, actions_coalesced));
+    metric(f, "actions_dropped_total", "counter", "Commands dropped because the queue was full.",
+           STAT_GET(s, actions_dropped));
+    metric(f, "sounds_total", "counter", "Bells that played the sound.", STAT_GET(s, sounds));
+    metric(f, "sounds_stolen_total", "counter", "Sounds restarted because every voice was playing.",
+           STAT_GET(s, sounds_stolen));
+    metric(f, "sound_underruns_total", "counter", "Times the sound device ran out of frames.",
+           STAT_GET(s, sound_xruns));
+    metric(f, "visible_flashes", "gauge", "Flashes currently on screen.", STAT_GET(s, visible));
+    metric(f, "resident_memory_bytes", "gauge", "Resident set size.", resident_bytes());
+    fprintf(f, "# HELP xvisbell_startup_seconds Time from exec to entering the event loop.\n"
+            "# TYPE xvisbell_startup_seconds gauge\nxvisbell_startup_seconds %.9f\n", STAT_GET(s, startup_ns) / 1e9);
+    fprintf(f, "# HELP xvisbell_first_flash_seconds Time from exec to the first flash, 0 before it.\n"
+            "# TYPE xvisbell_first_flash_seconds gauge\nxvisbell_first_flash_seconds %.9f\n",
+            STAT_GET(s, first_flash_ns) / 1e9);
+    metric(f, "texture_bytes", "gauge", "Server memory used by the textures of every screen.",
+           STAT_GET(s, texture_bytes));
+    fprintf(f, "# HELP xvisbell_texture_upload_seconds Time taken to upload the textures of every screen.\n"
+            "# TYPE xvisbell_texture_upload_seconds gauge\nxvisbell_texture_upload_seconds %.9f\n",
+            STAT_GET(s, texture_upload_ns) / 1e9);
+    metric_histogram(f, "bell_latency_seconds", "Time from receiving a bell to sending its map request.",
+                     &s->latency);
+    metric_histogram(f, "server_lag_seconds", "Time for the X server to process flash requests.",
+                     &s->server_lag);
+    metric_histogram(f, "spawn_latency_seconds", "Time spent starting a command.", &s->spawn);
+    fflush(f);
+}
+
+bool stats_write_metrics_file(const struct stats *s, const char *path) {
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int) sizeof(tmp)) return true;
+
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL) return true;
+    stats_print_metrics(s, f);
+    if (fclose(f) != 0) {
+        unlink(tmp);
+        return true;
+    }
+    return rename(tmp, path) != 0;
+}
+#endif
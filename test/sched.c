@@ -0,0 +1,120 @@
+/*
+   xvisbell: visual bell for X11
+
+   Tests of the flash scheduler: deadlines (which extending never brings
+   forward), and which flash gives way when there is no room (a louder
+   bell's flash evicts a quieter one's, a quieter one is refused while only
+   louder ones are visible).
+
+   Usage: test/sched
+   Exits with 1 if a check fails.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "../sched.h"
+#include "../xvisbell.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int failures = 0;
+
+#define CHECK(x)                                                    \
+    do {                                                            \
+        if (!(x)) {                                                 \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+            failures++;                                             \
+        }                                                           \
+    } while (0)
+
+// Keys of the flashes hidden so far, in order, and whether each expired
+static unsigned long hidden[SCHED_MAX_FLASHES];
+static bool hidden_expired[SCHED_MAX_FLASHES];
+static int n_hidden;
+
+static void record_hide(struct sched_flash *flash, bool expired, void *data) {
+    (void) data;
+    hidden_expired[n_hidden] = expired;
+    hidden[n_hidden++] = flash->key;
+}
+
+// What the scheduler under test counted
+static struct stats counts;
+
+static void init(struct scheduler *s, int max) {
+    counts = (struct stats) STATS_INIT;
+    *s = (struct scheduler){.max = max, .hide = record_hide, .stats = &counts};
+    n_hidden = 0;
+}
+
+// Add a flash the way show_flash does, returns false if it was refused
+static bool show(struct scheduler *s, unsigned long key, int priority, uint64_t end_ns) {
+    if (!sched_make_room(s, priority)) return false;
+    sched_add(s, key, key, priority, end_ns);
+    return true;
+}
+
+static void test_deadlines(void) {
+    struct scheduler s;
+    init(&s, 4);
+    uint64_t deadline;
+    CHECK(!sched_next_deadline(&s, &deadline));
+
+    CHECK(show(&s, 1, 0, 300));
+    CHECK(show(&s, 2, 0, 100));
+    CHECK(show(&s, 3, 0, 200));
+    CHECK(sched_next_deadline(&s, &deadline) && deadline == 100);
+
+    // Extending moves the flash to its new place in the heap
+    sched_extend(&s, sched_find(&s, 2), 0, 400);
+    CHECK(sched_next_deadline(&s, &deadline) && deadline == 200);
+
+    // A shorter bell on top of a longer flash doesn't bring its deadline forward
+    sched_extend(&s, sched_find(&s, 2), 0, 150);
+    CHECK(sched_next_deadline(&s, &deadline) && deadline == 200);
+    CHECK(s.heap[sched_find(&s, 2)].end_ns == 400);
+
+    CHECK(sched_expire(&s, 300) == 2);
+    CHECK(n_hidden == 2 && hidden[0] == 3 && hidden[1] == 1 && hidden_expired[0] && hidden_expired[1]);
+    CHECK(s.n == 1 && sched_find(&s, 2) == 0);
+}
+
+static void test_eviction(void) {
+    struct scheduler s;
+    init(&s, 2);
+
+    // Priorities as xvisbell_bell gives them: the bell's percent
+    CHECK(show(&s, 1, 30, 100));
+    CHECK(show(&s, 2, 80, 100));
+
+    // A louder bell evicts the quietest flash, not the one that expires first
+    CHECK(show(&s, 3, 50, 200));
+    CHECK(n_hidden == 1 && hidden[0] == 1 && !hidden_expired[0]);
+    CHECK(sched_find(&s, 1) < 0 && sched_find(&s, 2) >= 0 && sched_find(&s, 3) >= 0);
+    CHECK(STAT_GET(&counts, flashes_evicted) == 1);
+
+    // A quieter bell than everything visible is refused
+    CHECK(!show(&s, 4, 20, 200));
+    CHECK(n_hidden == 1 && s.n == 2);
+    CHECK(STAT_GET(&counts, flashes_refused) == 1);
+
+    // Extending keeps the higher priority, so the flash isn't evicted by a bell it outranked
+    sched_extend(&s, sched_find(&s, 3), 10, 300);
+    CHECK(!show(&s, 5, 40, 300));
+
+    // Equal priority makes room, as newer flashes matter more
+    CHECK(show(&s, 6, 50, 300));
+    CHECK(n_hidden == 2 && hidden[1] == 3);
+}
+
+int main(void) {
+    test_deadlines();
+    test_eviction();
+    if (failures) return 1;
+    printf("sched: OK\n");
+    return 0;
+}
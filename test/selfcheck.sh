@@ -0,0 +1,49 @@
+#!/bin/sh
+# Build xvisbell in each configuration of the optional parts (see the
+# Makefile) and check that it flashes: xvisbell --selfcheck on a local Xvfb
+# display has to see every flash mapped and unmapped. Each configuration is
+# built in a copy of the sources, so the tree's own build is left alone.
+# Skipped, saying so, when Xvfb isn't installed.
+#
+# Usage: test/selfcheck.sh [make flags]...
+# e.g. test/selfcheck.sh "MINIMAL=1" "" "FULL=1"
+# Defaults to MINIMAL=1 and the default build.
+
+set -e
+
+if ! command -v Xvfb >/dev/null; then
+    echo "selfcheck: skipped, Xvfb isn't installed"
+    exit 0
+fi
+
+if [ $# -eq 0 ]; then
+    set -- "MINIMAL=1" ""
+fi
+
+source=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+
+display=:${XVFB_DISPLAY:-99}
+Xvfb "$display" -screen 0 1920x1080x24 -nolisten tcp >/dev/null 2>&1 &
+xvfb=$!
+trap 'kill $xvfb 2>/dev/null; rm -rf "$work"' EXIT
+sleep 1
+if ! kill -0 $xvfb 2>/dev/null; then
+    echo "selfcheck: Xvfb didn't start on $display (set XVFB_DISPLAY to use another)"
+    exit 1
+fi
+
+for flags in "$@"; do
+    build=$work/build
+    rm -rf "$build"
+    mkdir "$build"
+    cp "$source"/*.c "$source"/*.h "$source"/Makefile "$build"
+    # Unquoted so there can be several flags
+    make -s -C "$build" $flags xvisbell >/dev/null
+    if ! DISPLAY=$display "$build/xvisbell" -d 2 --selfcheck 100 >"$work/out"; then
+        echo "selfcheck: FAILED with make ${flags:-(defaults)}"
+        cat "$work/out"
+        exit 1
+    fi
+    echo "selfcheck: OK with make ${flags:-(defaults)}"
+done
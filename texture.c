@@ -0,0 +1,239 @@
+/*
+   xvisbell: visual bell for X11
+
+   Textures: images uploaded once into a server-side pixmap for flash backgrounds
+
+   The pixels only cross the connection once, at startup. Through MIT-SHM
+   they don't cross it at all: the server reads them straight out of a
+   shared memory segment. Windows then use the pixmap as their background,
+   so showing a flash still costs a single map request.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "texture.h"
+#include "visual.h"
+#include "xerror.h"
+#include "xvisbell.h"
+
+#include <stdlib.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+// Put the image in a shared memory segment. Returns true if MIT-SHM can't be used.
+static bool create_shm(struct texture *t, Visual *visual, int depth) {
+    if (!XShmQueryExtension(t->display)) return true;
+
+    t->image = XShmCreateImage(t->display, visual, depth, ZPixmap, NULL, &t->shm, t->width, t->height);
+    if (t->image == NULL) return true;
+
+    t->shm.shmid = shmget(IPC_PRIVATE, (size_t) t->image->bytes_per_line * t->height, IPC_CREAT | 0600);
+    if (t->shm.shmid < 0) {
+        XDestroyImage(t->image);
+        return true;
+    }
+    t->shm.shmaddr = t->image->data = shmat(t->shm.shmid, NULL, 0);
+    t->shm.readOnly = True;
+
+    bool shm_failed = t->shm.shmaddr == (char *) -1;
+    if (!shm_failed) {
+        // Attaching fails asynchronously (e.g. when the server is on another machine),
+        // so wait for the server to say whether it worked
+        unsigned long first = NextRequest(t->display);
+        XShmAttach(t->display, &t->shm);
+        XSync(t->display, False);
+        shm_failed = xerror_since(t->errors, first);
+    }
+    // Mark the segment for removal now so it can't outlive xvisbell. It stays until both sides detach.
+    shmctl(t->shm.shmid, IPC_RMID, NULL);
+
+    if (shm_failed) {
+        if (t->shm.shmaddr != (char *) -1) shmdt(t->shm.shmaddr);
+        XDestroyImage(t->image);
+        return true;
+    }
+    return false;
+}
+
+bool texture_create(struct texture *t, Display *display, struct xerrors *errors, struct stats *stats, int screen,
+                    unsigned int width, unsigned int height) {
+    Visual *visual = XDefaultVisual(display, screen);
+    int depth = XDefaultDepth(display, screen);
+    if (visual->class != TrueColor || width == 0 || height == 0) return true;
+
+    t->display = display;
+    t->errors = errors;
+    t->stats = stats;
+    t->screen = screen;
+    t->width = width;
+    t->height = height;
+    t->pixmap = None;
+
+    visual_shifts(visual, t->shift, t->bits);
+
+    t->use_shm = !create_shm(t, visual, depth);
+    if (t->use_shm) return false;
+
+    t->image = XCreateImage(display, visual, depth, ZPixmap, 0, NULL, width, height, 32, 0);
+    if (t->image == NULL) return true;
+    t->image->data = malloc((size_t) t->image->bytes_per_line * height);
+    if (t->image->data == NULL) {
+        XDestroyImage(t->image);
+        return true;
+    }
+    return false;
+}
+
+void texture_set_rgb(struct texture *t, int x, int y, unsigned char r, unsigned char g, unsigned char b) {
+    unsigned char values[3] = {r, g, b};
+    unsigned long pixel = 0;
+    for (int i = 0; i < 3; i++) {
+        // Scale the 8 bit value to the width of the mask and move it into place
+        unsigned long value = t->bits[i] >= 8 ? (unsigned long) values[i] << (t->bits[i] - 8)
+                                              : (unsigned long) values[i] >> (8 - t->bits[i]);
+        pixel |= value << t->shift[i];
+    }
+    XPutPixel(t->image, x, y, pixel);
+}
+
+// Returns the image's pixels if they are native endian ARGB32 (with alpha ignored), NULL otherwise
+static uint32_t *argb32_pixels(struct texture *t) {
+    const uint32_t one = 1;
+    int native = *(const char *) &one ? LSBFirst : MSBFirst;
+    XImage *image = t->image;
+
+    if (image->bits_per_pixel != 32 || image->byte_order != native || image->bytes_per_line % 4
+        || image->red_mask != 0xff0000 || image->green_mask != 0xff00 || image->blue_mask != 0xff) {
+        return NULL;
+    }
+    return (uint32_t *) image->data;
+}
+
+bool texture_fill_gradient(struct texture *t, enum gradient_kind kind, uint32_t from, uint32_t to) {
+    uint64_t start = monotonic_ns();
+    enum gradient_kernel kernel = gradient_best_kernel();
+
+    uint32_t *pixels = argb32_pixels(t);
+    if (pixels) {
+        gradient_fill(pixels, t->image->bytes_per_line / 4, t->width, t->height, kind, from, to, kernel);
+    } else {
+        // Generate it separately and convert each pixel to the visual's format
+        pixels = malloc((size_t) t->width * t->height * sizeof(*pixels));
+        if (pixels == NULL) return true;
+        gradient_fill(pixels, t->width, t->width, t->height, kind, from, to, kernel);
+        for (unsigned int y = 0; y < t->height; y++) {
+            for (unsigned int x = 0; x < t->width; x++) {
+                uint32_t p = pixels[(size_t) y * t->width + x];
+                texture_set_rgb(t, x, y, p >> 16, p >> 8, p);
+            }
+        }
+        free(pixels);
+    }
+
+    STAT_ADD(t->stats, texture_generate_ns, monotonic_ns() - start);
+    STAT_SET(t->stats, texture_kernel, gradient_kernel_names[kernel]);
+    return false;
+}
+
+// Free the client side image and its shared memory
+static void free_image(struct texture *t) {
+    if (t->use_shm) XShmDetach(t->display, &t->shm);
+    // For shared memory images this leaves the segment alone
+    XDestroyImage(t->image);
+    if (t->use_shm) shmdt(t->shm.shmaddr);
+    t->image = NULL;
+}
+
+void texture_upload(struct texture *t) {
+    uint64_t start = monotonic_ns();
+    Display *display = t->display;
+
+    t->pixmap = XCreatePixmap(display, XRootWindow(display, t->screen), t->width, t->height, t->image->depth);
+    GC gc = XCreateGC(display, t->pixmap, 0, NULL);
+    if (t->use_shm) XShmPutImage(display, t->pixmap, gc, t->image, 0, 0, 0, 0, t->width, t->height, False);
+    else XPutImage(display, t->pixmap, gc, t->image, 0, 0, 0, 0, t->width, t->height);
+    XFreeGC(display, gc);
+    // The shared memory can't be released until the server has read it
+    XSync(display, False);
+
+    t->bytes = (uint64_t) t->image->bytes_per_line * t->height;
+    STAT_ADD(t->stats, textures, 1);
+    STAT_ADD(t->stats, textures_shm, t->use_shm);
+    STAT_ADD(t->stats, texture_upload_ns, monotonic_ns() - start);
+    STAT_ADD(t->stats, texture_bytes, t->bytes);
+    free_image(t);
+}
+
+void texture_free(struct texture *t) {
+    if (t->pixmap == None) return;
+    XFreePixmap(t->display, t->pixmap);
+    STAT_ADD(t->stats, texture_bytes, -t->bytes);
+    t->pixmap = None;
+}
+
+// Read a PPM header number, skipping whitespace and comments. Returns -1 on error.
+static long read_header_number(FILE *f) {
+    int c;
+    for (;;) {
+        c = getc(f);
+        if (c == '#') {
+            while (c != '\n' && c != EOF) c = getc(f);
+        } else if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            break;
+        }
+    }
+
+    long n = 0;
+    if (c < '0' || c > '9') return -1;
+    while (c >= '0' && c <= '9') {
+        if (n > 1000000) return -1;
+        n = n * 10 + c - '0';
+        c = getc(f);
+    }
+    // The single whitespace character after the last number is consumed here
+    return n;
+}
+
+bool texture_load_ppm(struct texture *t, Display *display, struct xerrors *errors, struct stats *stats, int screen,
+                      const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return true;
+
+    long width = -1, height = -1, maxval = -1;
+    if (getc(f) == 'P' && getc(f) == '6') {
+        width = read_header_number(f);
+        height = read_header_number(f);
+        maxval = read_header_number(f);
+    }
+    if (width <= 0 || height <= 0 || maxval <= 0 || maxval > 255
+        || texture_create(t, display, errors, stats, screen, width, height)) {
+        fclose(f);
+        return true;
+    }
+
+    unsigned char *row = malloc(width * 3);
+    bool error = row == NULL;
+    for (long y = 0; y < height && !error; y++) {
+        if (fread(row, 3, width, f) != (size_t) width) {
+            error = true;
+            break;
+        }
+        for (long x = 0; x < width; x++) {
+            unsigned char *p = &row[x * 3];
+            if (maxval == 255) texture_set_rgb(t, x, y, p[0], p[1], p[2]);
+            else texture_set_rgb(t, x, y, p[0] * 255 / maxval, p[1] * 255 / maxval, p[2] * 255 / maxval);
+        }
+    }
+    free(row);
+    fclose(f);
+
+    if (error) {
+        free_image(t);
+        return true;
+    }
+    texture_upload(t);
+    return false;
+}
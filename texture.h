@@ -0,0 +1,73 @@
+/*
+   xvisbell: visual bell for X11
+
+   Textures: images uploaded once into a server-side pixmap for flash backgrounds
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_TEXTURE_H
+#define XVISBELL_TEXTURE_H
+
+#include "gradient.h"
+#include "xerror.h"
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct texture {
+    Display *display;
+    struct xerrors *errors; // Where a failure to attach the shared memory turns up
+    struct stats *stats; // Where generating and uploading are counted
+    int screen;
+    XImage *image; // Client side pixels, NULL once uploaded
+    XShmSegmentInfo shm; // Shared memory holding the image if use_shm
+    bool use_shm;
+    Pixmap pixmap; // The uploaded texture, None until texture_upload
+    uint64_t bytes; // Size of the pixmap in the server
+    unsigned int width, height;
+    int shift[3], bits[3]; // Position and width of the red, green and blue masks in a pixel
+};
+
+/*
+ * Allocate a client side image in the format of the screen's default visual, in shared memory if MIT-SHM works
+ * Errors on the display must reach errors (see xerror_event), and the texture is counted in stats.
+ * Returns true on error
+ */
+bool texture_create(struct texture *t, Display *display, struct xerrors *errors, struct stats *stats, int screen,
+                    unsigned int width, unsigned int height);
+
+// Set a pixel of the client side image from 8 bit RGB
+void texture_set_rgb(struct texture *t, int x, int y, unsigned char r, unsigned char g, unsigned char b);
+
+/*
+ * Fill the client side image with a gradient between two ARGB colours using the fastest kernel
+ * On 32 bit x8r8g8b8 visuals (nearly all of them) it is generated straight into the shared memory.
+ * Returns true if a buffer for other visuals couldn't be allocated.
+ */
+bool texture_fill_gradient(struct texture *t, enum gradient_kind kind, uint32_t from, uint32_t to);
+
+/*
+ * Copy the image into a new pixmap and free the client side copy
+ * Adds the upload time and the pixmap's size to stats, which add up over every screen's texture.
+ */
+void texture_upload(struct texture *t);
+
+// Free the uploaded pixmap, if there is one
+void texture_free(struct texture *t);
+
+/*
+ * Load a binary PPM (P6) image into a pixmap
+ * Returns true on error
+ */
+bool texture_load_ppm(struct texture *t, Display *display, struct xerrors *errors, struct stats *stats, int screen,
+                      const char *path);
+
+#endif
@@ -0,0 +1,50 @@
+/*
+   xvisbell: visual bell for X11
+
+   In-process trace ring buffer
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "trace.h"
+
+#include <inttypes.h>
+#include <unistd.h>
+
+struct trace_ring trace_ring;
+
+static const char *trace_names[] = {
+    [TRACE_BELL] = "bell",
+    [TRACE_MAP] = "map",
+    [TRACE_FLUSH] = "flush",
+    [TRACE_TIMER] = "timer",
+    [TRACE_UNMAP] = "unmap",
+    [TRACE_X_ERROR] = "x error",
+};
+
+void trace_dump(const struct trace_ring *ring, FILE *f) {
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > TRACE_SIZE ? head - TRACE_SIZE : 0;
+    int pid = getpid();
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (uint64_t i = first; i < head; i++) {
+        const struct trace_event *e = &ring->events[i & (TRACE_SIZE - 1)];
+        if (e->type == TRACE_MAP || e->type == TRACE_UNMAP) {
+            // Flashes overlap (several screens or monitors, eviction), so each is an async slice of its own
+            // from map to unmap, matched up by its target
+            fprintf(f, "%s{\"name\":\"flash\",\"cat\":\"xvisbell\",\"ph\":\"%s\",\"id\":%" PRIu32 ","
+                    "\"ts\":%" PRIu64 ".%03" PRIu64 ",\"pid\":%d,\"tid\":%d}\n",
+                    i == first ? "" : ",", e->type == TRACE_MAP ? "b" : "e", e->arg, e->ns / 1000, e->ns % 1000, pid, pid);
+            continue;
+        }
+        fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"xvisbell\",\"ph\":\"i\",\"ts\":%" PRIu64 ".%03" PRIu64 ","
+                "\"pid\":%d,\"tid\":%d,\"args\":{\"arg\":%" PRIu32 "}}\n",
+                i == first ? "" : ",", trace_names[e->type], e->ns / 1000, e->ns % 1000, pid, pid, e->arg);
+    }
+    fprintf(f, "]}\n");
+    fflush(f);
+}
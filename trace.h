@@ -0,0 +1,73 @@
+/*
+   xvisbell: visual bell for X11
+
+   In-process trace ring buffer
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_TRACE_H
+#define XVISBELL_TRACE_H
+
+#include "xvisbell.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_SIZE 4096 // Number of events kept. Must be a power of 2
+
+enum trace_type {
+    TRACE_BELL, // Bell event received. arg is the bell's percent
+    TRACE_MAP, // Map request issued. arg is the flash's target, which identifies it while it is visible
+    TRACE_FLUSH, // Requests flushed. arg is the bell to request latency in us
+    TRACE_TIMER, // Flash timer expired. arg is how late it fired in us
+    TRACE_UNMAP, // Unmap request issued. arg is the flash's target
+    TRACE_X_ERROR, // X protocol error received. arg is the error code
+};
+
+struct trace_event {
+    uint64_t ns; // CLOCK_MONOTONIC
+    uint32_t type; // enum trace_type
+    uint32_t arg;
+};
+
+/*
+ * Only the event loop writes to the ring. Readers copy it without locking and
+ * may see the oldest few events being overwritten, which is fine for a trace.
+ * A libxvisbell context records into the ring in its config, if any.
+ */
+struct trace_ring {
+    struct trace_event events[TRACE_SIZE];
+    uint64_t head; // Total number of events ever written
+};
+
+#ifdef HAVE_TRACE
+// The daemon's
+extern struct trace_ring trace_ring;
+
+// Record an event in ring, unless it is NULL. Costs one clock_gettime (vDSO) and a few stores.
+static inline void trace(struct trace_ring *ring, enum trace_type type, uint32_t arg) {
+    if (ring == NULL) return;
+    uint64_t head = ring->head;
+    struct trace_event *e = &ring->events[head & (TRACE_SIZE - 1)];
+    e->ns = monotonic_ns();
+    e->type = type;
+    e->arg = arg;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Write the ring in Chrome trace event format, loadable in Perfetto or chrome://tracing
+void trace_dump(const struct trace_ring *ring, FILE *f);
+#else
+// Built without the trace ring (make TRACE=0), so recording costs nothing
+static inline void trace(struct trace_ring *ring, enum trace_type type, uint32_t arg) {
+    (void) ring;
+    (void) type;
+    (void) arg;
+}
+#endif
+
+#endif
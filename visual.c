@@ -0,0 +1,40 @@
+/*
+   xvisbell: visual bell for X11
+
+   Pixel values on TrueColor visuals, worked out without asking the server
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "visual.h"
+
+void visual_shifts(const Visual *visual, int shift[3], int bits[3]) {
+    unsigned long masks[3] = {visual->red_mask, visual->green_mask, visual->blue_mask};
+    for (int i = 0; i < 3; i++) {
+        unsigned long mask = masks[i];
+        shift[i] = bits[i] = 0;
+        while (mask && !(mask & 1)) {
+            mask >>= 1;
+            shift[i]++;
+        }
+        while (mask & 1) {
+            mask >>= 1;
+            bits[i]++;
+        }
+    }
+}
+
+unsigned long visual_pixel(const Visual *visual, const XColor *color) {
+    int shift[3], bits[3];
+    visual_shifts(visual, shift, bits);
+    unsigned short values[3] = {color->red, color->green, color->blue};
+    unsigned long pixel = 0;
+    for (int i = 0; i < 3; i++) {
+        // Scale the 16 bit value to the width of the mask and move it into place
+        pixel |= ((unsigned long) values[i] >> (16 - bits[i])) << shift[i];
+    }
+    return pixel;
+}
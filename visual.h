@@ -0,0 +1,23 @@
+/*
+   xvisbell: visual bell for X11
+
+   Pixel values on TrueColor visuals, worked out without asking the server
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_VISUAL_H
+#define XVISBELL_VISUAL_H
+
+#include <X11/Xlib.h>
+
+// Get the position and width of the red, green and blue masks in a pixel of a TrueColor visual
+void visual_shifts(const Visual *visual, int shift[3], int bits[3]);
+
+// Get the pixel value of a colour (16 bits per channel) on a TrueColor visual
+unsigned long visual_pixel(const Visual *visual, const XColor *color);
+
+#endif
@@ -0,0 +1,69 @@
+/*
+   xvisbell: visual bell for X11
+
+   X protocol errors: counting them, matching them to the requests that caused them and queueing recovery
+
+   Xlib's default handler exits on any error. Errors arrive asynchronously,
+   in the event stream, long after the request that caused them was queued,
+   so rather than syncing after requests that might fail their serials are
+   remembered along with what they were for. The handler can't send
+   requests itself, so it only counts the error and queues it; the
+   recovery (e.g. dropping a flash whose window is gone) happens once Xlib
+   is safe to use again.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#include "xerror.h"
+
+void xerror_init(struct xerrors *e, Display *display, struct stats *stats, struct trace_ring *ring) {
+    e->display = display;
+    e->stats = stats;
+    e->trace = ring;
+    e->next_tag = 0;
+    e->n_failures = 0;
+    e->any = false;
+    for (int i = 0; i < XERROR_TAGS; i++) e->tags[i] = (struct xerror_tag){0};
+}
+
+void xerror_tag(struct xerrors *e, unsigned long first, unsigned long key, Window window) {
+    unsigned long end = NextRequest(e->display);
+    if (end == first) return;
+    e->tags[e->next_tag] = (struct xerror_tag){first, end, key, window};
+    e->next_tag = (e->next_tag + 1) % XERROR_TAGS;
+}
+
+void xerror_count(struct stats *stats, struct trace_ring *ring, const XErrorEvent *error) {
+    // Core errors are counted by code, extensions' all together
+    STAT_ADD(stats, x_errors[error->error_code < STATS_X_ERROR_CODES ? error->error_code : 0], 1);
+    stats_changed(stats);
+    trace(ring, TRACE_X_ERROR, error->error_code);
+}
+
+void xerror_event(struct xerrors *e, const XErrorEvent *error) {
+    xerror_count(e->stats, e->trace, error);
+    e->any = true;
+    e->last_serial = error->serial;
+    if (e->n_failures == XERROR_FAILURES) return;
+
+    struct xerror_failure *f = &e->failures[e->n_failures++];
+    *f = (struct xerror_failure){.code = error->error_code, .resource = error->resourceid};
+    for (int i = 0; i < XERROR_TAGS; i++) {
+        if (error->serial >= e->tags[i].first && error->serial < e->tags[i].end) {
+            f->tagged = true;
+            f->tag = e->tags[i];
+            break;
+        }
+    }
+}
+
+bool xerror_take(struct xerrors *e, struct xerror_failure *failure) {
+    if (e->n_failures == 0) return false;
+    *failure = e->failures[0];
+    e->n_failures--;
+    for (int i = 0; i < e->n_failures; i++) e->failures[i] = e->failures[i + 1];
+    return true;
+}
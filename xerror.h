@@ -0,0 +1,84 @@
+/*
+   xvisbell: visual bell for X11
+
+   X protocol errors: counting them, matching them to the requests that caused them and queueing recovery
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+ */
+
+#ifndef XVISBELL_XERROR_H
+#define XVISBELL_XERROR_H
+
+#include "trace.h"
+#include "xvisbell.h"
+
+#include <X11/Xlib.h>
+
+#include <stdbool.h>
+
+#define XERROR_TAGS 64 // Tagged requests remembered, enough for everything sent while an error is on its way back
+#define XERROR_FAILURES 32 // Errors waiting for xerror_take, more are only counted
+
+// What a run of requests was for
+struct xerror_tag {
+    unsigned long first, end; // Serials of the requests, from first up to but not including end
+    unsigned long key; // e.g. the target of a flash
+    Window window; // e.g. the window of a flash
+};
+
+// An error to recover from
+struct xerror_failure {
+    unsigned char code; // e.g. BadWindow
+    XID resource; // The resource the error was about
+    bool tagged; // Whether the request was tagged, and with what
+    struct xerror_tag tag;
+};
+
+struct xerrors {
+    Display *display;
+    struct stats *stats; // Where errors are counted
+    struct trace_ring *trace; // Where errors are traced, NULL for nowhere
+    struct xerror_tag tags[XERROR_TAGS]; // Oldest overwritten first
+    int next_tag;
+    struct xerror_failure failures[XERROR_FAILURES];
+    int n_failures;
+    bool any; // Whether there has been an error, and the serial of the last one
+    unsigned long last_serial;
+};
+
+// Start matching the display's errors, counting them in stats and tracing them in ring. Nothing is sent.
+void xerror_init(struct xerrors *e, Display *display, struct stats *stats, struct trace_ring *ring);
+
+/*
+ * Note that the requests from first (NextRequest before sending them) up to now were for key and window
+ * If one of them fails, xerror_take gives back the tag.
+ */
+void xerror_tag(struct xerrors *e, unsigned long first, unsigned long key, Window window);
+
+// Count an error in stats and trace it in ring, unless that is NULL
+void xerror_count(struct stats *stats, struct trace_ring *ring, const XErrorEvent *error);
+
+/*
+ * Count an error on the display and queue it for recovery
+ * Call it from the error handler (see XSetErrorHandler). Never sends requests.
+ */
+void xerror_event(struct xerrors *e, const XErrorEvent *error);
+
+/*
+ * Check whether any of the requests from first (NextRequest before sending them) have failed so far
+ * After a round trip that is all of them, e.g. to tell whether a window that was looked up still exists.
+ */
+static inline bool xerror_since(const struct xerrors *e, unsigned long first) {
+    return e->any && e->last_serial >= first;
+}
+
+/*
+ * Get the oldest error to recover from
+ * Returns false if there are none
+ */
+bool xerror_take(struct xerrors *e, struct xerror_failure *failure);
+
+#endif
@@ -21,27 +21,46 @@
    along with this program; if not, see <http://www.gnu.org/licenses/>.
  */
 
+// For CPU affinity
+#define _GNU_SOURCE
+
+#include "action.h"
+#ifdef HAVE_ALSA
+#include "audio.h"
+#endif
+#include "control.h"
+#include "libxvisbell.h"
+#include "probes.h"
+#include "queue.h"
+#include "record.h"
+#include "selfcheck.h"
+#include "trace.h"
+#include "xvisbell.h"
+
 #include <X11/XKBlib.h>
 #include <X11/Xlib.h>
 
 #include <errno.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include <sys/mman.h>
 #include <sys/select.h>
 #include <sys/time.h>
+#include <unistd.h>
 
-// Define clock_gettime since it's not implemented on older versions of OS X (< 10.12)
+#ifdef XVISBELL_CLOCK_SHIM
 // from https://stackoverflow.com/a/9781275
-#if defined(__MACH__) && !defined(CLOCK_MONOTONIC)
-#include <sys/time.h>
-#define CLOCK_MONOTONIC 0
 int clock_gettime(int /*clk_id*/, struct timespec*t) {
     struct timeval now;
     int rv = gettimeofday(&now, NULL);
@@ -56,13 +75,114 @@ int clock_gettime(int /*clk_id*/, struct timespec*t) {
 // If true then flash one time and exit instead of listening for X's bell
 bool flash_once = false;
 
-// Visual bell
+// Flashes to time with --selfcheck, 0 to run normally
+unsigned long selfcheck = 0;
+// Whether --selfcheck-latency rings the bell itself to time each stage until the flash is drawn instead
+bool selfcheck_damage = false;
+
+// How flashes look and behave
+struct xvisbell_config config = XVISBELL_CONFIG_DEFAULT;
+
+// Commands to run when the bell rings
+struct action_pipeline actions = ACTION_PIPELINE_DEFAULT;
+
+// Bell trace being written (--record) and read (--replay)
+struct recorder recorder = {NULL};
+struct replay replay = {.records = NULL, .speed = 1};
+
+// Where SIGUSR2 writes the trace ring. NULL means /tmp/xvisbell-<pid>.trace.json
+char *trace_path = NULL;
+
+// Path of the control socket, NULL if there isn't one
+char *control_path = NULL;
+
+// SCHED_FIFO priority of a dedicated event thread, 0 to run everything on one ordinary thread
+unsigned long rt_priority = 0;
+
+// CPU the event loop is pinned to, -1 for any
+long event_cpu = -1;
+
+// Whether to lock all memory so the event loop never waits for a page fault
+bool lock_memory = false;
+
+// Stack size of the event thread, which only runs the event loop
+#define EVENT_THREAD_STACK (256 * 1024)
+
+// With --rt-priority: messages between the event thread and the main thread, and the main thread asking it to stop
+bool threaded = false;
+struct queue to_control, to_events;
+bool stopping = false;
+
+// WAV file played for each bell, NULL for silence, and the ALSA device to play it on
+char *sound_path = NULL;
+char *sound_device = "default";
+#ifdef HAVE_ALSA
+struct audio audio;
+#endif
+
+// The context whose X errors are recovered from, NULL until there is one
+struct xvisbell *x_error_context = NULL;
+
+// Whether to leave the server's own audible bell on
+bool audible_bell = false;
+
+// Exit after this many seconds without bells or commands, 0 to stay resident
+unsigned long idle_exit = 0;
+
+// CLOCK_MONOTONIC when main() started
+uint64_t start_ns;
+
+// If true then print how long each part of startup took and exit
+bool startup_trace = false;
+
+// Startup phases and how long each took, for --startup-trace
+#define MAX_STARTUP_PHASES 8
 struct {
-    int x, y; // Position
-    long w, h; // Dimensions. -1 means match display size
-    unsigned long duration; // Duration in ms
-    char *color; // Color as an X11 color name
-} bell = {0, 0, -1, -1, 100, NULL};
+    const char *name;
+    uint64_t ns;
+} startup_phases[MAX_STARTUP_PHASES];
+int n_startup_phases = 0;
+
+// Record that the named part of startup just finished
+static void startup_phase(const char *name) {
+    static uint64_t last_ns = 0;
+    uint64_t now = monotonic_ns();
+
+    if (last_ns == 0) last_ns = start_ns;
+    if (n_startup_phases < MAX_STARTUP_PHASES) {
+        startup_phases[n_startup_phases].name = name;
+        startup_phases[n_startup_phases].ns = now - last_ns;
+        n_startup_phases++;
+    }
+    last_ns = now;
+}
+
+static void print_startup_phases(FILE *f) {
+    for (int i = 0; i < n_startup_phases; i++) {
+        fprintf(f, "%s: %" PRIu64 " us\n", startup_phases[i].name, startup_phases[i].ns / 1000);
+    }
+    fprintf(f, "ready: %" PRIu64 " us\n", (monotonic_ns() - start_ns) / 1000);
+}
+
+// Prometheus textfile collector output, NULL if metrics aren't written to a file
+char *metrics_path = NULL;
+unsigned long metrics_interval = 10; // Minimum seconds between writes
+
+// When the last bell or command arrived, for --idle-exit. Set from any thread.
+uint64_t last_activity;
+
+// Set by signal handlers, which only run while the main loop is in pselect()
+volatile sig_atomic_t got_sigchld = 0;
+volatile sig_atomic_t got_sigusr1 = 0;
+volatile sig_atomic_t got_sigusr2 = 0;
+volatile sig_atomic_t got_sigterm = 0;
+
+static void handle_signal(int sig) {
+    if (sig == SIGCHLD) got_sigchld = 1;
+    else if (sig == SIGUSR1) got_sigusr1 = 1;
+    else if (sig == SIGUSR2) got_sigusr2 = 1;
+    else got_sigterm = 1;
+}
 
 
 // Returns the difference between start and end or {0, 0} if end is before start
@@ -82,6 +202,16 @@ struct timespec timespec_diff(struct timespec *start, struct timespec *end) {
     return result;
 }
 
+// Returns a + b with tv_nsec normalized to [0, 1e9)
+struct timespec timespec_add(struct timespec *a, struct timespec *b) {
+    struct timespec result = {a->tv_sec + b->tv_sec, a->tv_nsec + b->tv_nsec};
+    if (result.tv_nsec >= 1000000000) {
+        result.tv_sec++;
+        result.tv_nsec -= 1000000000;
+    }
+    return result;
+}
+
 /*
  * Parse a long from a string
  * If s is a valid long then l is set to the long value of s and false is returned
@@ -114,13 +244,107 @@ bool parse_ulong(char *s, unsigned long *l) {
     return false;
 }
 
+/*
+ * Parse a number of milliseconds with up to three decimal places (i.e. to the microsecond) from a string
+ * If s is valid then ns is set to it in nanoseconds and false is returned
+ * Otherwise true is returned and ns is not modified
+ */
+bool parse_ms(char *s, uint64_t *ns) {
+    char *end;
+
+    if (*s < '0' || *s > '9') return true; // strtoul would accept a sign or leading spaces
+    errno = 0;
+    unsigned long ms = strtoul(s, &end, 10);
+    if (errno == ERANGE || ms > UINT64_MAX / 1000000) return true;
+    // Parsed as digits rather than a double so e.g. 0.1 is exactly 100 us
+    uint64_t us = 0;
+    if (*end == '.') {
+        int digits = 0;
+        for (end++; *end >= '0' && *end <= '9'; end++, digits++) {
+            if (digits == 3) return true; // Finer than a microsecond
+            us = us * 10 + (*end - '0');
+        }
+        if (digits == 0) return true;
+        for (; digits < 3; digits++) us *= 10;
+    }
+    if (*end != '\0') return true; // String had non-digit chars after the parsed value
+    *ns = ms * 1000000ULL + us * 1000;
+    return false;
+}
+
+/*
+ * Parse a double from a string
+ * If s is a valid double then d is set to the value of s and false is returned
+ * Otherwise true is returned and d is not modified
+ */
+bool parse_double(char *s, double *d) {
+    char *end;
+
+    errno = 0;
+    double parsed = strtod(s, &end);
+    if (errno == ERANGE || end == s) return true;
+    if (*end != '\0') return true; // String had non-digit chars after the parsed value
+    *d = parsed;
+    return false;
+}
+
 void print_usage(char *argv[]) {
-    printf("Usage: %s [-h <height>] [-w <width] [-x <x position>] [-y <y position>] [-c <colour name>]\n", argv[0]);
+    printf("Usage: %s [-h <height>] [-w <width] [-x <x position>] [-y <y position>] [-c <colour name>]"
+           " [-d <ms duration>] [-f] [-e <command>] [--exec-max <n>] [--exec-queue <n>]"
+           " [--exec-policy coalesce|drop] [--record <file>] [--replay <file>] [--replay-speed <factor>]"
+           " [--control <socket path>] [--trace-file <file>]"
+           " [--metrics-file <file>] [--metrics-interval <seconds>] [--lazy] [--idle-exit <seconds>]"
+           " [--startup-trace] [--max-flashes <n>] [--pool-size <n>] [--renderer window|overlay]"
+           " [--opacity <percent>] [--image <file.ppm>] [--gradient horizontal|vertical|vignette]"
+           " [--gradient-from <colour name>] [--max-lag <ms>] [--rt-priority <1-99>] [--cpu <n>] [--mlock]"
+           " [--sound <file.wav>] [--sound-device <ALSA device>] [--audible-bell]"
+           " [--intensity] [--min-opacity <percent>] [--pitch-ramp <colour name>]"
+           " [--client-rate <bells per second>] [--follow-focus window|monitor] [--selfcheck <flashes>]"
+           " [--selfcheck-latency <bells>]\n",
+           argv[0]);
 }
 
+// Values for long options without a short equivalent
+enum {
+    OPT_EXEC_MAX = 256,
+    OPT_EXEC_QUEUE,
+    OPT_EXEC_POLICY,
+    OPT_RECORD,
+    OPT_REPLAY,
+    OPT_REPLAY_SPEED,
+    OPT_CONTROL,
+    OPT_TRACE_FILE,
+    OPT_METRICS_FILE,
+    OPT_METRICS_INTERVAL,
+    OPT_LAZY,
+    OPT_IDLE_EXIT,
+    OPT_STARTUP_TRACE,
+    OPT_MAX_FLASHES,
+    OPT_POOL_SIZE,
+    OPT_RENDERER,
+    OPT_OPACITY,
+    OPT_IMAGE,
+    OPT_GRADIENT,
+    OPT_GRADIENT_FROM,
+    OPT_MAX_LAG,
+    OPT_RT_PRIORITY,
+    OPT_CPU,
+    OPT_MLOCK,
+    OPT_SOUND,
+    OPT_SOUND_DEVICE,
+    OPT_AUDIBLE_BELL,
+    OPT_INTENSITY,
+    OPT_MIN_OPACITY,
+    OPT_PITCH_RAMP,
+    OPT_CLIENT_RATE,
+    OPT_FOLLOW_FOCUS,
+    OPT_SELFCHECK,
+    OPT_SELFCHECK_LATENCY,
+};
+
 void parse_args(int argc, char *argv[]) {
-    char option;
-    struct option long_opts[10] = {
+    int option;
+    struct option long_opts[] = {
         {"help", no_argument, NULL, 0},
         {"width", required_argument, NULL, 'w'},
         {"height", required_argument, NULL, 'h'},
@@ -131,11 +355,47 @@ void parse_args(int argc, char *argv[]) {
         {"colour", required_argument, NULL, 'c'},
         {"duration", required_argument, NULL, 'd'},
         {"flash", no_argument, NULL, 'f'},
+        {"exec", required_argument, NULL, 'e'},
+        {"exec-max", required_argument, NULL, OPT_EXEC_MAX},
+        {"exec-queue", required_argument, NULL, OPT_EXEC_QUEUE},
+        {"exec-policy", required_argument, NULL, OPT_EXEC_POLICY},
+        {"record", required_argument, NULL, OPT_RECORD},
+        {"replay", required_argument, NULL, OPT_REPLAY},
+        {"replay-speed", required_argument, NULL, OPT_REPLAY_SPEED},
+        {"control", required_argument, NULL, OPT_CONTROL},
+        {"trace-file", required_argument, NULL, OPT_TRACE_FILE},
+        {"metrics-file", required_argument, NULL, OPT_METRICS_FILE},
+        {"metrics-interval", required_argument, NULL, OPT_METRICS_INTERVAL},
+        {"lazy", no_argument, NULL, OPT_LAZY},
+        {"idle-exit", required_argument, NULL, OPT_IDLE_EXIT},
+        {"startup-trace", no_argument, NULL, OPT_STARTUP_TRACE},
+        {"max-flashes", required_argument, NULL, OPT_MAX_FLASHES},
+        {"pool-size", required_argument, NULL, OPT_POOL_SIZE},
+        {"renderer", required_argument, NULL, OPT_RENDERER},
+        {"opacity", required_argument, NULL, OPT_OPACITY},
+        {"image", required_argument, NULL, OPT_IMAGE},
+        {"gradient", required_argument, NULL, OPT_GRADIENT},
+        {"gradient-from", required_argument, NULL, OPT_GRADIENT_FROM},
+        {"max-lag", required_argument, NULL, OPT_MAX_LAG},
+        {"rt-priority", required_argument, NULL, OPT_RT_PRIORITY},
+        {"cpu", required_argument, NULL, OPT_CPU},
+        {"mlock", no_argument, NULL, OPT_MLOCK},
+        {"sound", required_argument, NULL, OPT_SOUND},
+        {"sound-device", required_argument, NULL, OPT_SOUND_DEVICE},
+        {"audible-bell", no_argument, NULL, OPT_AUDIBLE_BELL},
+        {"intensity", no_argument, NULL, OPT_INTENSITY},
+        {"min-opacity", required_argument, NULL, OPT_MIN_OPACITY},
+        {"pitch-ramp", required_argument, NULL, OPT_PITCH_RAMP},
+        {"client-rate", required_argument, NULL, OPT_CLIENT_RATE},
+        {"follow-focus", required_argument, NULL, OPT_FOLLOW_FOCUS},
+        {"selfcheck", required_argument, NULL, OPT_SELFCHECK},
+        {"selfcheck-latency", required_argument, NULL, OPT_SELFCHECK_LATENCY},
         {0, 0, 0, 0} // Last element must have all 0s for getopt_long
     };
     long tmp; // buffer for parsing arguments for options
+    unsigned long utmp; // buffer for parsing unsigned arguments for options
 
-    while ((option = getopt_long(argc, argv, "w:h:x:y:c:d:f", long_opts, NULL)) != -1) {
+    while ((option = getopt_long(argc, argv, "w:h:x:y:c:d:fe:", long_opts, NULL)) != -1) {
         switch (option) {
             case 0: // --help
                 print_usage(argv);
@@ -150,8 +410,8 @@ void parse_args(int argc, char *argv[]) {
                     printf("Invalid width. The maximum width is %d\n", UINT_MAX);
                     exit(1);
                 }
-                if (tmp < 0) bell.w = -1;
-                else bell.w = (long) tmp;
+                if (tmp < 0) config.width = -1;
+                else config.width = tmp;
                 break;
 
             case 'h': // --height
@@ -163,8 +423,8 @@ void parse_args(int argc, char *argv[]) {
                     printf("Invalid height. The maximum height is %d\n", UINT_MAX);
                     exit(1);
                 }
-                if (tmp < 0) bell.h = -1;
-                else bell.h = (long) tmp;
+                if (tmp < 0) config.height = -1;
+                else config.height = tmp;
                 break;
 
             case 'x': // --x
@@ -176,7 +436,7 @@ void parse_args(int argc, char *argv[]) {
                     printf("Invalid x. Must be an integer in the range (%d, %d)\n", INT_MIN, INT_MAX);
                     exit(1);
                 }
-                bell.x = (int) tmp;
+                config.x = (int) tmp;
                 break;
 
             case 'y': // --y
@@ -188,13 +448,13 @@ void parse_args(int argc, char *argv[]) {
                     printf("Invalid y. Must be an integer in the range (%d, %d)\n", INT_MIN, INT_MAX);
                     exit(1);
                 }
-                bell.y = (int) tmp;
+                config.y = (int) tmp;
                 break;
 
             case 'c': // --color, --colour
                 errno = 0;
-                bell.color = strdup(optarg);
-                if (bell.color == NULL) {
+                config.color = strdup(optarg);
+                if (config.color == NULL) {
                     printf("Error setting color to %s", optarg);
                     if (errno == 0) printf("\n");
                     else printf(" (%d). Make sure you are using a valid X11 color name\n", errno);
@@ -203,8 +463,9 @@ void parse_args(int argc, char *argv[]) {
                 break;
 
             case 'd': // --duration
-                if (parse_ulong(optarg, &bell.duration)) {
-                    printf("Invalid duration %s. Should be a non-negative number of milliseconds.\n", optarg);
+                if (parse_ms(optarg, &config.duration_ns)) {
+                    printf("Invalid duration %s. Should be a non-negative number of milliseconds,"
+                           " to at most three decimal places.\n", optarg);
                     exit(1);
                 }
                 break;
@@ -213,6 +474,251 @@ void parse_args(int argc, char *argv[]) {
                 flash_once = true;
                 break;
 
+            case 'e': // --exec
+                if (action_add_command(&actions, optarg)) {
+                    printf("Too many commands. At most %d can be given\n", ACTION_MAX_COMMANDS);
+                    exit(1);
+                }
+                break;
+
+            case OPT_EXEC_MAX:
+                if (parse_ulong(optarg, &utmp) || utmp == 0 || utmp > ACTION_MAX_RUNNING) {
+                    printf("Invalid --exec-max %s. Must be in the range [1, %d]\n", optarg, ACTION_MAX_RUNNING);
+                    exit(1);
+                }
+                actions.max_running = utmp;
+                break;
+
+            case OPT_EXEC_QUEUE:
+                if (parse_ulong(optarg, &utmp) || utmp > ACTION_MAX_QUEUE) {
+                    printf("Invalid --exec-queue %s. Must be in the range [0, %d]\n", optarg, ACTION_MAX_QUEUE);
+                    exit(1);
+                }
+                actions.max_queued = utmp;
+                break;
+
+            case OPT_EXEC_POLICY:
+                if (strcmp(optarg, "coalesce") == 0) actions.policy = ACTION_COALESCE;
+                else if (strcmp(optarg, "drop") == 0) actions.policy = ACTION_DROP;
+                else {
+                    printf("Invalid --exec-policy %s. Must be coalesce or drop\n", optarg);
+                    exit(1);
+                }
+                break;
+
+            case OPT_RECORD:
+                if (record_open(&recorder, optarg)) {
+                    printf("Error opening %s for recording (errno %d)\n", optarg, errno);
+                    exit(1);
+                }
+                break;
+
+            case OPT_REPLAY:
+                if (replay_open(&replay, optarg)) {
+                    printf("Error reading trace %s. Make sure it was written by --record on this machine\n", optarg);
+                    exit(1);
+                }
+                break;
+
+            case OPT_REPLAY_SPEED:
+                if (parse_double(optarg, &replay.speed) || replay.speed < 0) {
+                    printf("Invalid --replay-speed %s. Must be a non-negative number (0 replays without delays)\n",
+                           optarg);
+                    exit(1);
+                }
+                break;
+
+            case OPT_CONTROL:
+                control_path = optarg;
+                break;
+
+            case OPT_TRACE_FILE:
+#ifndef HAVE_TRACE
+                printf("xvisbell was built without the trace ring. Rebuild it with make TRACE=1\n");
+                exit(1);
+#endif
+                trace_path = optarg;
+                break;
+
+            case OPT_METRICS_FILE:
+#ifndef HAVE_METRICS
+                printf("xvisbell was built without metrics. Rebuild it with make METRICS=1\n");
+                exit(1);
+#endif
+                metrics_path = optarg;
+                break;
+
+            case OPT_METRICS_INTERVAL:
+                if (parse_ulong(optarg, &metrics_interval) || metrics_interval == 0) {
+                    printf("Invalid --metrics-interval %s. Must be a positive number of seconds\n", optarg);
+                    exit(1);
+                }
+                break;
+
+            case OPT_LAZY:
+                config.lazy = true;
+                break;
+
+            case OPT_IDLE_EXIT:
+                if (parse_ulong(optarg, &idle_exit)) {
+                    printf("Invalid --idle-exit %s. Must be a non-negative number of seconds\n", optarg);
+                    exit(1);
+                }
+                break;
+
+            case OPT_STARTUP_TRACE:
+                startup_trace = true;
+                break;
+
+            case OPT_MAX_FLASHES:
+                if (parse_ulong(optarg, &config.max_flashes) || config.max_flashes == 0
+                    || config.max_flashes > SCHED_MAX_FLASHES) {
+                    printf("Invalid --max-flashes %s. Must be in the range [1, %d]\n", optarg, SCHED_MAX_FLASHES);
+                    exit(1);
+                }
+                break;
+
+            case OPT_POOL_SIZE:
+                if (parse_ulong(optarg, &config.pool_size) || config.pool_size == 0
+                    || config.pool_size > POOL_MAX_WINDOWS) {
+                    printf("Invalid --pool-size %s. Must be in the range [1, %d]\n", optarg, POOL_MAX_WINDOWS);
+                    exit(1);
+                }
+                break;
+
+            case OPT_RENDERER:
+                if (strcmp(optarg, "window") == 0) config.renderer = XVISBELL_RENDERER_WINDOW;
+                else if (strcmp(optarg, "overlay") == 0) config.renderer = XVISBELL_RENDERER_OVERLAY;
+                else {
+                    printf("Invalid --renderer %s. Must be window or overlay\n", optarg);
+                    exit(1);
+                }
+#ifndef HAVE_RENDER
+                if (config.renderer == XVISBELL_RENDERER_OVERLAY) {
+                    printf("xvisbell was built without the overlay renderer. Rebuild it with make RENDER=1\n");
+                    exit(1);
+                }
+#endif
+                break;
+
+            case OPT_OPACITY:
+                if (parse_ulong(optarg, &config.opacity) || config.opacity > 100) {
+                    printf("Invalid --opacity %s. Must be a percentage in the range [0, 100]\n", optarg);
+                    exit(1);
+                }
+                break;
+
+            case OPT_IMAGE:
+                config.image_path = optarg;
+                break;
+
+            case OPT_GRADIENT:
+                config.gradient = true;
+                if (strcmp(optarg, "horizontal") == 0) config.gradient_kind = GRADIENT_HORIZONTAL;
+                else if (strcmp(optarg, "vertical") == 0) config.gradient_kind = GRADIENT_VERTICAL;
+                else if (strcmp(optarg, "vignette") == 0) config.gradient_kind = GRADIENT_VIGNETTE;
+                else {
+                    printf("Invalid --gradient %s. Must be horizontal, vertical or vignette\n", optarg);
+                    exit(1);
+                }
+                break;
+
+            case OPT_GRADIENT_FROM:
+                config.gradient_from = optarg;
+                break;
+
+            case OPT_MAX_LAG:
+                if (parse_ulong(optarg, &utmp)) {
+                    printf("Invalid --max-lag %s. Must be a non-negative number of milliseconds\n", optarg);
+                    exit(1);
+                }
+                config.max_lag_ns = utmp * 1000000ULL;
+                break;
+
+            case OPT_RT_PRIORITY:
+                if (parse_ulong(optarg, &rt_priority) || rt_priority < 1 || rt_priority > 99) {
+                    printf("Invalid --rt-priority %s. Must be in the range [1, 99]\n", optarg);
+                    exit(1);
+                }
+                break;
+
+            case OPT_CPU:
+                if (parse_long(optarg, &event_cpu) || event_cpu < 0 || event_cpu >= CPU_SETSIZE) {
+                    printf("Invalid --cpu %s. Must be in the range [0, %d]\n", optarg, CPU_SETSIZE - 1);
+                    exit(1);
+                }
+                break;
+
+            case OPT_MLOCK:
+                lock_memory = true;
+                break;
+
+            case OPT_SOUND:
+#ifndef HAVE_ALSA
+                printf("xvisbell was built without sound support. Rebuild it with make AUDIO=1\n");
+                exit(1);
+#endif
+                sound_path = optarg;
+                break;
+
+            case OPT_SOUND_DEVICE:
+                sound_device = optarg;
+                break;
+
+            case OPT_AUDIBLE_BELL:
+                audible_bell = true;
+                break;
+
+            case OPT_INTENSITY:
+                config.intensity = true;
+                break;
+
+            case OPT_MIN_OPACITY:
+                if (parse_ulong(optarg, &config.min_opacity) || config.min_opacity > 100) {
+                    printf("Invalid --min-opacity %s. Must be a percentage in the range [0, 100]\n", optarg);
+                    exit(1);
+                }
+                break;
+
+            case OPT_PITCH_RAMP:
+                config.pitch_ramp = optarg;
+                break;
+
+            case OPT_CLIENT_RATE:
+                if (parse_ulong(optarg, &config.client_rate) || config.client_rate == 0) {
+                    printf("Invalid --client-rate %s. Must be a positive number of bells per second\n", optarg);
+                    exit(1);
+                }
+                break;
+
+            case OPT_FOLLOW_FOCUS:
+                if (strcmp(optarg, "window") == 0) config.follow_focus = XVISBELL_FOLLOW_WINDOW;
+                else if (strcmp(optarg, "monitor") == 0) config.follow_focus = XVISBELL_FOLLOW_MONITOR;
+                else {
+                    printf("Invalid --follow-focus %s. Must be window or monitor\n", optarg);
+                    exit(1);
+                }
+                break;
+
+            case OPT_SELFCHECK:
+                if (parse_ulong(optarg, &selfcheck) || selfcheck == 0) {
+                    printf("Invalid --selfcheck %s. Must be a positive number of flashes\n", optarg);
+                    exit(1);
+                }
+                break;
+
+            case OPT_SELFCHECK_LATENCY:
+#ifndef HAVE_XDAMAGE
+                printf("xvisbell was built without Damage support. Rebuild it with make DAMAGE=1\n");
+                exit(1);
+#endif
+                if (parse_ulong(optarg, &selfcheck) || selfcheck == 0) {
+                    printf("Invalid --selfcheck-latency %s. Must be a positive number of bells\n", optarg);
+                    exit(1);
+                }
+                selfcheck_damage = true;
+                break;
+
             default:
                 // Print error message if getopt didn't already
                 if (option != '?') {
@@ -222,155 +728,598 @@ void parse_args(int argc, char *argv[]) {
                 exit(1);
         }
     }
+
+    if ((config.image_path || config.gradient) && config.renderer == XVISBELL_RENDERER_OVERLAY) {
+        printf("--image and --gradient only work with --renderer window\n");
+        exit(1);
+    }
+    if (config.image_path && config.gradient) {
+        printf("--image and --gradient can't be used together\n");
+        exit(1);
+    }
+    if ((config.intensity || config.pitch_ramp) && config.renderer == XVISBELL_RENDERER_OVERLAY) {
+        printf("--intensity and --pitch-ramp only work with --renderer window\n");
+        exit(1);
+    }
+    if (selfcheck && !selfcheck_damage && config.renderer == XVISBELL_RENDERER_OVERLAY) {
+        printf("--selfcheck only works with --renderer window\n");
+        exit(1);
+    }
+    if (config.pitch_ramp && (config.image_path || config.gradient)) {
+        printf("--pitch-ramp can't be used with --image or --gradient\n");
+        exit(1);
+    }
 }
 
-static inline void update_timeout_and_hide(struct timespec *now, struct timespec *end_time, struct timespec *timeout,
-                                           Display **display, int *window, bool *visible) {
-    clock_gettime(CLOCK_MONOTONIC, now);
-    *timeout = timespec_diff(now, end_time);
-    if (timeout->tv_sec == 0 && timeout->tv_nsec == 0) {
-        XUnmapWindow(*display, *window);
-        *visible = false;
+/*
+ * Everything a bell does besides flashing, called by libxvisbell once the flash is queued
+ * Throttled bells are only recorded.
+ */
+static void on_bell(XkbBellNotifyEvent *ev, uint64_t recv_ns, bool limited, void *data) {
+    (void) data;
+    __atomic_store_n(&last_activity, recv_ns, __ATOMIC_RELAXED);
+#ifdef HAVE_ALSA
+    if (sound_path && !limited) audio_bell(&audio);
+#endif
+
+    if (threaded) {
+        // Spawning commands and writing the trace happen on the main thread so they can't delay flashes
+        // If the main thread has fallen QUEUE_SIZE bells behind this one's actions are dropped
+        struct message m = {.type = limited ? MESSAGE_RECORD : MESSAGE_BELL, .ns = recv_ns, .bell = *ev};
+        queue_push(&to_control, &m);
+    } else {
+        if (recorder.f) record_event(&recorder, ev, recv_ns);
+        if (!limited) action_bell(&actions);
     }
 }
 
-// Flash the screen once then exit(0)
-// Never returns
-void flash_once_and_exit(Display *display, Window window, struct timespec *duration) {
-    struct timespec now, timeout, end_time;
+/*
+ * Xlib's default handler exits on any error, e.g. about a window destroyed just before its flash
+ * Errors are recovered from by the context, or only counted if it is about another display or there is none yet.
+ */
+int handle_x_error(Display *display, XErrorEvent *error) {
+    if (x_error_context == NULL || !xvisbell_x_error(x_error_context, display, error)) {
+        xerror_count(&stats, config.trace, error);
+    }
+    return 0;
+}
 
-    clock_gettime(CLOCK_MONOTONIC, &end_time);
-    end_time.tv_sec += duration->tv_sec;
-    end_time.tv_nsec += duration->tv_nsec;
+/*
+ * Flash the screen once then exit(0)
+ * Only the window is set up: a one-shot flash has no business changing the audible bell.
+ * Never returns
+ */
+void flash_once_and_exit(Display *display, struct timespec *duration) {
+    struct xvisbell v;
+    struct xvisbell_config once = config;
+    once.lazy = false;
+    once.on_bell = NULL;
+    xvisbell_init(&v, display, &once);
+    x_error_context = &v;
 
-    // Create and display the window
-    XMapRaised(display, window);
-    XFlush(display);
-    bool visible = true;
+    // Creating and mapping the window go out in a single write (unless the active window has to be looked up first)
+    XkbBellNotifyEvent ev = {.xkb_type = XkbBellNotify, .device = XkbUseCoreKbd, .percent = 100};
+    if (xvisbell_setup(&v)) {
+        printf("%s\n", xvisbell_error(&v));
+        exit(1);
+    }
+    if (once.follow_focus) focus_resolve(&v.focus);
+    if (xvisbell_bell(&v, &ev, monotonic_ns())) {
+        printf("%s\n", xvisbell_error(&v));
+        exit(1);
+    }
+    xvisbell_flush(&v);
 
-    // Wait for duration then destroy the window and return
-    // This should only have 2 iterations max in normal circumstances
-    while (visible) {
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    end_time = timespec_add(&end_time, duration);
+
+#ifdef TIMER_ABSTIME
+    // Sleeping until an absolute deadline can't drift however often it is interrupted
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &end_time, NULL) == EINTR);
+#else
+    struct timespec now, timeout;
+    do {
         clock_gettime(CLOCK_MONOTONIC, &now);
         timeout = timespec_diff(&now, &end_time);
-        if (timeout.tv_sec == 0 && timeout.tv_nsec == 0) {
-            XUnmapWindow(display, window);
-            exit(0);
-        }
-        nanosleep(&timeout, NULL);
-    }
+    } while ((timeout.tv_sec || timeout.tv_nsec) && nanosleep(&timeout, NULL));
+#endif
+
+    // Closing the display destroys the window, no need to unmap it first
+    XCloseDisplay(display);
     exit(0);
 }
 
-int main(int argc, char *argv[]) {
-    parse_args(argc, argv);
-
-    Display *display = XOpenDisplay(NULL);
-    if (!display) {
-        printf("Error opening display\n");
-        return 1;
+/*
+ * Time selfcheck flashes and print how long they were really visible (or how long each stage took to draw them),
+ * then exit
+ * Like a one-shot flash only the windows are set up (and bell events, to time from the bell), and nothing else runs.
+ * Never returns
+ */
+void selfcheck_and_exit(Display *display) {
+    struct xvisbell v;
+    struct xvisbell_config check = config;
+    check.lazy = false;
+    check.on_bell = NULL;
+    xvisbell_init(&v, display, &check);
+    x_error_context = &v;
+    // Only timing the whole way from the bell needs bell events
+    if ((selfcheck_damage && xvisbell_listen(&v)) || xvisbell_setup(&v)) {
+        printf("%s\n", xvisbell_error(&v));
+        exit(1);
     }
+#ifdef HAVE_XDAMAGE
+    bool failed = selfcheck_damage ? selfcheck_latency(&v, selfcheck, stdout) : selfcheck_run(&v, selfcheck, stdout);
+#else
+    bool failed = selfcheck_run(&v, selfcheck, stdout);
+#endif
+    XCloseDisplay(display);
+    exit(failed);
+}
 
-    int screen = XDefaultScreen(display);
-    Window root = XRootWindow(display, screen);
-    Visual *visual = XDefaultVisual(display, screen);
+// Request number when the main loop started, to count requests sent since
+unsigned long first_request;
 
-    int major = XkbMajorVersion;
-    int minor = XkbMinorVersion;
+// Write the metrics file and note that it is up to date
+void write_metrics_file(void) {
+    stats_take_changed(&stats);
+#ifdef HAVE_METRICS
+    if (stats_write_metrics_file(&stats, metrics_path)) {
+        printf("Error writing metrics to %s (errno %d)\n", metrics_path, errno);
+    }
+#endif
+}
 
-    if (!XkbLibraryVersion(&major, &minor)) {
-        printf("X server doesn't support Xkb extension\n");
-        return 1;
+// Write the trace ring to trace_path
+void dump_trace(void) {
+#ifndef HAVE_TRACE
+    printf("xvisbell was built without the trace ring. Rebuild it with make TRACE=1\n");
+#else
+    char default_path[64];
+    char *path = trace_path;
+    if (path == NULL) {
+        snprintf(default_path, sizeof(default_path), "/tmp/xvisbell-%d.trace.json", (int) getpid());
+        path = default_path;
     }
 
-    major = XkbMajorVersion;
-    minor = XkbMinorVersion;
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        printf("Error opening trace file %s (errno %d)\n", path, errno);
+        return;
+    }
+    trace_dump(&trace_ring, f);
+    fclose(f);
+#endif
+}
 
-    int xkb_event_base;
-    if (!XkbQueryExtension(display, NULL, &xkb_event_base,
-                           NULL, &major, &minor)) {
-        printf("X server has wrong version of Xkb extension (try rebuilding xvisbell)\n");
-        return 1;
+// Flash for a bell that didn't come from the server, exiting if the flash couldn't be set up
+static void flash_bell(struct xvisbell *v, XkbBellNotifyEvent *ev, uint64_t recv_ns) {
+    if (xvisbell_bell(v, ev, recv_ns)) {
+        printf("%s\n", xvisbell_error(v));
+        exit(1);
     }
+}
+
+// Commands that are only there if they were built in, for listing the commands
+#ifdef HAVE_TRACE
+#define COMMAND_TRACE ", trace"
+#else
+#define COMMAND_TRACE ""
+#endif
+#ifdef HAVE_METRICS
+#define COMMAND_METRICS ", metrics"
+#else
+#define COMMAND_METRICS ""
+#endif
 
-    XkbSelectEvents(display, XkbUseCoreKbd, XkbBellNotifyMask, XkbBellNotifyMask);
+// Answer one control socket command
+void run_command(struct xvisbell *v, const char *command, FILE *out) {
+    if (strcmp(command, "flash") == 0) {
+        if (threaded) {
+            // The event thread owns the display
+            struct message m = {.type = MESSAGE_FLASH, .ns = monotonic_ns()};
+            fprintf(out, queue_push(&to_events, &m) ? "busy\n" : "ok\n");
+            return;
+        }
+        // Handled exactly like a bell rung at full volume
+        XkbBellNotifyEvent ev = {.xkb_type = XkbBellNotify, .device = XkbUseCoreKbd, .percent = 100};
+        flash_bell(v, &ev, monotonic_ns());
+        xvisbell_flush(v);
+        fprintf(out, "ok\n");
+    } else if (strcmp(command, "stats") == 0) stats_print(&stats, out);
+#ifdef HAVE_TRACE
+    else if (strcmp(command, "trace") == 0) trace_dump(&trace_ring, out);
+#endif
+#ifdef HAVE_METRICS
+    else if (strcmp(command, "metrics") == 0) stats_print_metrics(&stats, out);
+#endif
+    else fprintf(out, "Unknown command %s. Commands are: flash, stats%s%s\n", command,
+                 COMMAND_TRACE, COMMAND_METRICS);
+}
 
-    unsigned int auto_ctrls, auto_values;
-    auto_ctrls = auto_values = XkbAudibleBellMask;
+/*
+ * What a run of the main loop looks after
+ * Without --rt-priority one loop does everything; with it the event thread
+ * runs the events half and the main thread the control half.
+ */
+struct loop {
+    bool events; // X events, flashes and replay
+    bool control; // Signals, bell actions, metrics and the control socket
+    struct xvisbell *v;
+    int control_fd; // -1 if there is no control socket
+    sigset_t *wait_mask; // Signal mask while waiting, NULL to leave signals blocked
+};
 
-    XkbSetAutoResetControls(display, XkbAudibleBellMask, &auto_ctrls, &auto_values);
-    XkbChangeEnabledControls(display, XkbUseCoreKbd, XkbAudibleBellMask, 0);
+static void add_fd(int fd, fd_set *fds, int *max_fd) {
+    FD_SET(fd, fds);
+    if (fd > *max_fd) *max_fd = fd;
+}
 
-    XSetWindowAttributes attrs;
-    attrs.override_redirect = True;
-    attrs.save_under = True;
-    // Set background colour
-    if (bell.color == NULL || strncmp(bell.color, "white", 5) == 0) {
-        attrs.background_pixel = WhitePixel(display, screen);
-    } else {
-        XColor rgb, nearest;
-        attrs.colormap = XDefaultColormap(display, screen);
-        if (!XAllocNamedColor(display, attrs.colormap, bell.color, &rgb, &nearest)) {
-            printf("Colour %s isn't supported\n", bell.color);
+// Tell the main thread the event loop finished by itself. Without --rt-priority it is the main thread.
+static void finish_events(void) {
+    struct message m = {.type = MESSAGE_EXIT};
+    if (threaded) while (queue_push(&to_control, &m)) usleep(1000);
+}
+
+static void run_loop(struct loop *l) {
+    struct xvisbell *v = l->v;
+    Display *display = v->display;
+
+    // Metrics are written when something changed, at most once per interval, so an idle daemon never wakes up
+    uint64_t metrics_due = 0;
+
+    while (!got_sigterm && !__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+        uint64_t now = monotonic_ns();
+        uint64_t wake = UINT64_MAX; // When pselect has to return, UINT64_MAX to wait indefinitely
+        uint64_t replay_deadline;
+        // The replay belongs to the events half
+        bool replaying = l->events && replay.records && replay_next_deadline(&replay, &replay_deadline);
+        fd_set in_fds;
+        int max_fd = -1;
+        FD_ZERO(&in_fds);
+
+        if (l->events) {
+            // A finished replay exits once its last flash is gone
+            if (replay.records && !replaying && xvisbell_visible(v) == 0) {
+                finish_events();
+                return;
+            }
+
+            add_fd(xvisbell_fd(v), &in_fds, &max_fd);
+            if (threaded) add_fd(queue_fd(&to_events), &in_fds, &max_fd);
+
+            // Without a visible window or idle pooled ones there is nothing to time out
+            wake = xvisbell_next_deadline(v);
+            if (replaying && replay_deadline < wake) wake = replay_deadline;
+
+#ifdef HAVE_ALSA
+            uint64_t audio_deadline;
+            if (sound_path) {
+                audio_run(&audio, now);
+                if (audio_next_deadline(&audio, &audio_deadline) && audio_deadline < wake) wake = audio_deadline;
+            }
+#endif
+
+            if (idle_exit && xvisbell_visible(v) == 0) {
+                uint64_t idle_due = __atomic_load_n(&last_activity, __ATOMIC_RELAXED) + idle_exit * 1000000000ULL;
+                if (now >= idle_due) {
+                    finish_events();
+                    return;
+                }
+                if (idle_due < wake) wake = idle_due;
+            }
+        }
+
+        if (l->control) {
+            if (l->control_fd >= 0) add_fd(l->control_fd, &in_fds, &max_fd);
+            if (threaded) add_fd(queue_fd(&to_control), &in_fds, &max_fd);
+
+            if (metrics_path && STAT_GET(&stats, changed)) {
+                if (now >= metrics_due) {
+                    write_metrics_file();
+                    metrics_due = now + metrics_interval * 1000000000ULL;
+                } else if (metrics_due < wake) {
+                    wake = metrics_due;
+                }
+            }
+        }
+
+        struct timespec timeout, *timeout_ptr = NULL;
+        if (wake != UINT64_MAX) {
+            now = monotonic_ns();
+            uint64_t wait = wake > now ? wake - now : 0;
+            timeout = (struct timespec){wait / 1000000000, wait % 1000000000};
+            timeout_ptr = &timeout;
+        }
+
+        if (l->events) {
+            // Send any queued requests (e.g. the unmap above) before sleeping
+            XFlush(display);
+            STAT_SET(&stats, x_requests, NextRequest(display) - first_request);
+        }
+        int ready = pselect(max_fd + 1, &in_fds, NULL, NULL, timeout_ptr, l->wait_mask);
+        // Compare with sched:sched_wakeup to see how long the kernel took to run us
+        PROBE1(wakeup, ready);
+        if (ready < 0 && errno != EINTR) {
+            printf("Error in select() (errno %d)\n", errno);
             exit(1);
         }
-        attrs.background_pixel = nearest.pixel;
+
+        if (l->control) {
+            if (got_sigchld) {
+                got_sigchld = 0;
+                action_reap(&actions);
+                stats_changed(&stats);
+            }
+            if (got_sigusr1) {
+                got_sigusr1 = 0;
+                stats_print(&stats, stdout);
+                if (recorder.f) record_flush(&recorder);
+            }
+            if (got_sigusr2) {
+                got_sigusr2 = 0;
+                dump_trace();
+            }
+
+            struct message m;
+            bool recorded = false;
+            while (threaded && queue_pop(&to_control, &m)) {
+                if (m.type == MESSAGE_EXIT) return;
+                if (recorder.f) record_event(&recorder, &m.bell, m.ns);
+                recorded = true;
+                if (m.type == MESSAGE_BELL) action_bell(&actions);
+            }
+            // Writing the trace can't hold up flashes when they're on another thread
+            if (recorded && recorder.f) record_flush(&recorder);
+        }
+
+        if (l->events) {
+            if (replaying) {
+                XkbBellNotifyEvent ev;
+                now = monotonic_ns();
+                while (replay_next_event(&replay, now, v->xkb_event_base, &ev)) flash_bell(v, &ev, now);
+            }
+
+            struct message m;
+            while (threaded && queue_pop(&to_events, &m)) {
+                // Handled exactly like a bell rung at full volume
+                XkbBellNotifyEvent ev = {.xkb_type = XkbBellNotify, .device = XkbUseCoreKbd, .percent = 100};
+                flash_bell(v, &ev, m.ns);
+            }
+
+            // Bells from the server are handed to on_bell as they are read
+            if (xvisbell_dispatch(v)) {
+                printf("%s\n", xvisbell_error(v));
+                exit(1);
+            }
+            // Nothing is showing so this is a good time to write out the trace (the main thread does it with --rt-priority)
+            if (xvisbell_visible(v) == 0 && recorder.f && !threaded) record_flush(&recorder);
+        }
+
+        if (l->control && ready > 0 && l->control_fd >= 0 && FD_ISSET(l->control_fd, &in_fds)) {
+            char command[CONTROL_MAX_COMMAND];
+            int client = control_accept(l->control_fd, command, sizeof(command));
+            if (client >= 0) {
+                FILE *out = fdopen(client, "w");
+                if (out) {
+                    run_command(v, command, out);
+                    __atomic_store_n(&last_activity, monotonic_ns(), __ATOMIC_RELAXED);
+                    fclose(out);
+                } else {
+                    close(client);
+                }
+            }
+        }
     }
+}
 
-    int x11_fd = ConnectionNumber(display);
+static void *event_thread(void *arg) {
+    run_loop(arg);
+    return NULL;
+}
 
-    // When to hide the window (from CLOCK_MONOTONIC)
-    struct timespec end_time;
+/*
+ * Run the event loop on its own SCHED_FIFO thread and everything else on this one
+ * Xlib isn't initialised for threads: only the event thread uses the display until it is joined.
+ */
+static void run_threaded(struct loop *control, struct loop *events) {
+    if (queue_init(&to_control) || queue_init(&to_events)) {
+        printf("Error creating the event thread's queues (errno %d)\n", errno);
+        exit(1);
+    }
+    threaded = true;
+    // Changes on the event thread have to wake this one to write the metrics
+    if (metrics_path) stats.wake_fd = to_control.wake[1];
 
-    // Whether the window is visible
-    bool visible = false;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    // A small stack so --mlock doesn't pin the default 8 MB
+    pthread_attr_setstacksize(&attr, EVENT_THREAD_STACK);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    struct sched_param param = {.sched_priority = rt_priority};
+    pthread_attr_setschedparam(&attr, &param);
+    if (event_cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(event_cpu, &cpus);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    }
 
-    // How long to show the window for
-    struct timespec duration = {bell.duration / 1000, (bell.duration % 1000) * 1000000};
+    pthread_t thread;
+    int error = pthread_create(&thread, &attr, event_thread, events);
+    pthread_attr_destroy(&attr);
+    if (error) {
+        printf("Error starting the event thread with SCHED_FIFO priority %lu: %s", rt_priority, strerror(error));
+        if (error == EPERM) printf(". It needs CAP_SYS_NICE or an RLIMIT_RTPRIO of at least that");
+        // e.g. a CPU that doesn't exist
+        else if (error == EINVAL && event_cpu >= 0) printf(". Check --cpu %ld", event_cpu);
+        printf("\n");
+        exit(1);
+    }
 
-    // Window shape
-    int width = bell.w < 0 ? DisplayWidth(display, screen) : bell.w;
-    int height = bell.h < 0 ? DisplayHeight(display, screen) : bell.h;
+    run_loop(control);
 
-    int window = XCreateWindow(display, root, bell.x, bell.y,
-                               width, height, 0,
-                               XDefaultDepth(display, screen), InputOutput,
-                               visual,
-                               CWBackPixel | CWOverrideRedirect | CWSaveUnder,
-                               &attrs);
+    // Stop the event thread if the main thread is the one finishing, e.g. on SIGTERM
+    __atomic_store_n(&stopping, true, __ATOMIC_RELAXED);
+    char byte = 0;
+    ssize_t written = write(to_events.wake[1], &byte, 1);
+    (void) written;
+    pthread_join(thread, NULL);
+}
 
-    if (flash_once) flash_once_and_exit(display, window, &duration);
+int main(int argc, char *argv[]) {
+    start_ns = monotonic_ns();
+    parse_args(argc, argv);
+    // Every context counts into the process-wide stats, which SIGUSR1, the metrics and the control socket show
+    config.stats = &stats;
+#ifdef HAVE_TRACE
+    config.trace = &trace_ring;
+#endif
 
-    for (;;) {
-        struct timespec now, timeout = {0, 0};
+    /*
+     * Every call that waits for a reply costs a round trip, so the requests that
+     * don't are issued first and are sent along with the one at the end.
+     * Round trips: opening the display, querying Xkb and setting auto-reset
+     * controls (plus allocating the colour if it has to be looked up by name).
+     */
+    Display *display = XOpenDisplay(NULL);
+    if (!display) {
+        printf("Error opening display\n");
+        return 1;
+    }
+    startup_phase("open display");
+    XSetErrorHandler(handle_x_error);
 
-        fd_set in_fds;
-        FD_ZERO(&in_fds);
-        FD_SET(x11_fd, &in_fds);
+    if (flash_once) {
+        struct timespec duration = {config.duration_ns / 1000000000, config.duration_ns % 1000000000};
+        flash_once_and_exit(display, &duration);
+    }
+    if (selfcheck) selfcheck_and_exit(display);
 
-        if (visible) update_timeout_and_hide(&now, &end_time, &timeout, &display, &window, &visible);
+    config.start_ns = start_ns;
+    config.on_bell = on_bell;
+    struct xvisbell v;
+    xvisbell_init(&v, display, &config);
+    x_error_context = &v;
+    if (xvisbell_listen(&v)) {
+        printf("%s\n", xvisbell_error(&v));
+        return 1;
+    }
+    startup_phase("query xkb");
 
-x11select:
-        if (pselect(x11_fd + 1, &in_fds, NULL, NULL, &timeout, NULL) < 0) {
-            if (errno == EINTR) goto x11select;
-            printf("Error in select() (errno %d)\n", errno);
+    if (!audible_bell) XkbChangeEnabledControls(display, XkbUseCoreKbd, XkbAudibleBellMask, 0);
+
+    // With --lazy the window is created by the first flash instead
+    if (xvisbell_setup(&v)) {
+        printf("%s\n", xvisbell_error(&v));
+        return 1;
+    }
+    if (!config.lazy && v.config.renderer != config.renderer) {
+        printf("A compositor is running, so flashes are shown in windows instead of on the overlay\n");
+    }
+    startup_phase("create window");
+
+#ifdef HAVE_ALSA
+    if (sound_path) {
+        if (audio_load_wav(&audio, sound_path)) {
+            printf("Error loading %s. It must be an uncompressed 16 bit PCM WAV file\n", sound_path);
             return 1;
         }
+        int error = audio_open(&audio, sound_device);
+        if (error < 0) {
+            printf("Error opening sound device %s (%s)\n", sound_device, snd_strerror(error));
+            return 1;
+        }
+        startup_phase("open sound");
+    }
+#endif
+
+    if (audible_bell) {
+        XSync(display, False);
+    } else {
+        // Restore the audible bell when xvisbell exits. This waits for a reply so it also syncs everything above.
+        unsigned int auto_ctrls, auto_values;
+        auto_ctrls = auto_values = XkbAudibleBellMask;
+
+        XkbSetAutoResetControls(display, XkbAudibleBellMask, &auto_ctrls, &auto_values);
+    }
+    startup_phase("sync");
+
+    if (startup_trace) {
+        print_startup_phases(stdout);
+        return 0;
+    }
 
-        if (visible) update_timeout_and_hide(&now, &end_time, &timeout, &display, &window, &visible);
+    // Count requests from here on so replays of the same trace can be compared
+    first_request = NextRequest(display);
+    if (replay.records) replay_start(&replay);
 
-        while (XPending(display)) {
-            XEvent ev;
-            XNextEvent(display, &ev);
+    if (lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        printf("Error locking memory (errno %d). It needs CAP_IPC_LOCK or a large enough RLIMIT_MEMLOCK\n", errno);
+        return 1;
+    }
+
+    // Signals are only delivered while waiting in pselect() so handlers can't interrupt Xlib.
+    // The event thread inherits the blocked mask, so with --rt-priority they all go to the main thread.
+    sigset_t handled, wait_mask;
+    sigemptyset(&handled);
+    sigaddset(&handled, SIGCHLD);
+    sigaddset(&handled, SIGUSR1);
+    sigaddset(&handled, SIGUSR2);
+    sigaddset(&handled, SIGINT);
+    sigaddset(&handled, SIGTERM);
+    sigprocmask(SIG_BLOCK, &handled, &wait_mask);
 
-            if (((XkbEvent *) &ev)->any.xkb_type != XkbBellNotify) continue;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGCHLD, &sa, NULL);
+    sigaction(SIGUSR1, &sa, NULL);
+    sigaction(SIGUSR2, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    // Control socket clients may hang up before reading their reply
+    signal(SIGPIPE, SIG_IGN);
+
+    // A socket passed by systemd (or anything else following the LISTEN_FDS protocol) takes precedence
+    int control_fd = control_from_listen_fds();
+    if (control_fd >= 0) control_path = NULL;
+    else if (control_path) {
+        control_fd = control_open(control_path);
+        if (control_fd < 0) {
+            printf("Error opening control socket %s (errno %d)\n", control_path, errno);
+            return 1;
+        }
+    }
 
-            XMapRaised(display, window);
+    last_activity = monotonic_ns();
+    STAT_SET(&stats, startup_ns, last_activity - start_ns);
 
-            visible = true;
-            clock_gettime(CLOCK_MONOTONIC, &end_time);
-            end_time.tv_sec += duration.tv_sec;
-            end_time.tv_nsec += duration.tv_nsec;
+    if (rt_priority) {
+        struct loop control = {false, true, &v, control_fd, &wait_mask};
+        struct loop events = {true, false, &v, -1, NULL};
+        run_threaded(&control, &events);
+    } else {
+        if (event_cpu >= 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(event_cpu, &cpus);
+            if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0) {
+                printf("Error pinning xvisbell to CPU %ld (errno %d)\n", event_cpu, errno);
+                return 1;
+            }
         }
+        struct loop loop = {true, true, &v, control_fd, &wait_mask};
+        run_loop(&loop);
     }
+
+    STAT_SET(&stats, x_requests, NextRequest(display) - first_request);
+    if (recorder.f) record_flush(&recorder);
+    if (replay.records) stats_print(&stats, stdout);
+    if (metrics_path) write_metrics_file();
+    if (control_path) unlink(control_path);
+    XCloseDisplay(display);
+    return 0;
 }
@@ -0,0 +1,164 @@
+/*
+   xvisbell: visual bell for X11
+
+   Copyright 2015 Rian Hunter <rian@alum.mit.edu>
+   Copyright 2020 Alexander French <a.french@mail.utoronto.ca>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published
+   by the Free Software Foundation; either version 3 of the License,
+   or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XVISBELL_H
+#define XVISBELL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Define clock_gettime since it's not implemented on older versions of OS X (< 10.12)
+// The definition lives in xvisbell.c
+#if defined(__MACH__) && !defined(CLOCK_MONOTONIC)
+#define XVISBELL_CLOCK_SHIM
+#define CLOCK_MONOTONIC 0
+int clock_gettime(int /*clk_id*/, struct timespec *t);
+#endif
+
+// Upper bounds of the histogram buckets in us. Anything slower goes in the last (+Inf) bucket.
+#define HISTOGRAM_BOUNDS {10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 100000}
+#define HISTOGRAM_BUCKETS 13
+
+// Latency distribution, exported as a Prometheus histogram
+struct histogram {
+    uint64_t buckets[HISTOGRAM_BUCKETS]; // Not cumulative
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+};
+
+void histogram_observe(struct histogram *h, uint64_t ns);
+
+#define STATS_TOP_CLIENTS 5 // Noisiest clients listed in the stats
+#define STATS_X_ERROR_CODES 18 // X errors are counted by core error code (1 to 17), extension errors under 0
+
+// Bells rung by one client, see clients.h
+struct client_stats {
+    uint64_t id; // Resource ID base, 0 for bells that didn't name a window
+    uint64_t pid; // 0 if unknown
+    uint64_t bells; // 0 for an unused slot
+    uint64_t rate_limited;
+};
+
+/*
+ * Counters of a libxvisbell context, and of whatever else the host counts along with it
+ * The daemon's context counts into the process-wide stats, printed on SIGUSR1; other hosts' contexts have their own.
+ */
+struct stats {
+    uint64_t bells; // Bell events received
+    uint64_t bells_deferred; // Bells that waited for their window to be located before flashing
+    uint64_t flashes; // Times the window was mapped
+    uint64_t extended; // Bells that arrived while a flash was already visible
+    uint64_t visible; // Flashes on screen right now
+    uint64_t flashes_evicted; // Flashes hidden early to make room for one with at least the same priority
+    uint64_t flashes_refused; // Flashes not shown because every visible one had a higher priority
+    uint64_t pool_hits; // Flashes shown in an existing window
+    uint64_t pool_misses; // Flashes that had to create a window
+    uint64_t pool_size; // Flash windows alive right now, in every screen's pool
+    uint64_t backpressure_merged; // Bells folded into the visible flash because the server was lagging
+    uint64_t backpressure_dropped; // Bells not flashed because the server was lagging
+    uint64_t rate_limited; // Bells ignored because their client was over --client-rate
+    struct client_stats top_clients[STATS_TOP_CLIENTS]; // Clients that rang the most bells, most first
+    uint64_t x_errors[STATS_X_ERROR_CODES]; // X protocol errors by code
+    uint64_t flashes_failed; // Flashes dropped because one of their requests failed
+    struct histogram server_lag; // From flushing flash requests to the server having processed them (--max-lag)
+    struct histogram latency; // From receiving a bell to sending its map request
+    uint64_t x_requests; // X requests sent since startup, updated before printing
+    uint64_t startup_ns; // From main() to entering the event loop
+    uint64_t first_flash_ns; // From main() to sending the first map request, 0 before the first flash
+    uint64_t textures; // Textures uploaded, one per screen with --image or --gradient
+    uint64_t textures_shm; // Textures uploaded through MIT-SHM
+    uint64_t texture_upload_ns; // Time taken to upload every texture
+    uint64_t texture_bytes; // Size of the textures' pixmaps in the server, 0 if there are none
+    uint64_t texture_generate_ns; // Time taken to generate every --gradient texture
+    const char *texture_kernel; // Gradient kernel used (the same for every screen), NULL if no gradient was generated
+
+    uint64_t sounds; // Bells that started the --sound sample
+    uint64_t sounds_stolen; // Bells that restarted the oldest voice because every voice was playing
+    uint64_t sound_xruns; // Times the sound device ran out of frames
+
+    bool changed; // Whether anything changed since the metrics were last written. Set and cleared from any thread.
+    int wake_fd; // Written a byte when changed is set, e.g. a pipe waking the thread that writes metrics. -1 for none.
+
+    uint64_t actions_spawned; // Commands started by the action pipeline
+    uint64_t actions_failed; // posix_spawn failures
+    uint64_t actions_queued; // Commands that had to wait for a free slot
+    uint64_t actions_coalesced; // Commands merged into an already queued run
+    uint64_t actions_dropped; // Commands dropped because the queue was full
+    struct histogram spawn; // Time spent in posix_spawn
+};
+
+#define STATS_INIT {.wake_fd = -1}
+
+// The daemon's
+extern struct stats stats;
+
+/*
+ * Access the stats s from any thread
+ * Each field has a single writer (with --rt-priority, the event thread or the
+ * control thread), so a relaxed load and store is enough for readers to see
+ * whole values and costs the same as a plain increment. The exception is
+ * changed, which is only touched through stats_changed and stats_take_changed.
+ */
+#define STAT_GET(s, field) __atomic_load_n(&(s)->field, __ATOMIC_RELAXED)
+#define STAT_SET(s, field, value) __atomic_store_n(&(s)->field, (value), __ATOMIC_RELAXED)
+#define STAT_ADD(s, field, n) STAT_SET(s, field, STAT_GET(s, field) + (n))
+
+// Write a byte to s->wake_fd
+void stats_wake(struct stats *s);
+
+// Note that the metrics need writing out again
+static inline void stats_changed(struct stats *s) {
+    // Only the first change since the metrics were written has anyone to wake
+    if (!STAT_GET(s, changed) && !__atomic_exchange_n(&s->changed, true, __ATOMIC_RELAXED) && s->wake_fd >= 0) {
+        stats_wake(s);
+    }
+}
+
+// Clear changed, returning whether it was set. A change noted after this sets it again.
+static inline bool stats_take_changed(struct stats *s) {
+    return __atomic_exchange_n(&s->changed, false, __ATOMIC_RELAXED);
+}
+
+// Print stats in a human readable form
+void stats_print(const struct stats *s, FILE *f);
+
+#ifdef HAVE_METRICS
+// Print stats in the Prometheus text exposition format
+void stats_print_metrics(const struct stats *s, FILE *f);
+
+// Write metrics to path atomically (through a temporary file and rename). Returns true on error.
+bool stats_write_metrics_file(const struct stats *s, const char *path);
+#endif
+
+static inline uint64_t timespec_to_ns(const struct timespec *t) {
+    return (uint64_t) t->tv_sec * 1000000000ULL + t->tv_nsec;
+}
+
+// CLOCK_MONOTONIC in nanoseconds
+static inline uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return timespec_to_ns(&now);
+}
+
+#endif